@@ -5,8 +5,10 @@
 #include <functional>
 using namespace std;
 
+#include <double_tan.hpp>
 #include "utils.h"
 #include "gauss.h"
+#include <intrinsics.hpp>
 
 namespace burgersFunction {
 
@@ -122,8 +124,8 @@ inline void newton(const int m, const double& d, const vector<T>& y_prev, vector
     f(m,d,y,y_prev,r, diffusion_t, advection);
     while (norm(r)>eps) {
         dfdy(m,d,y,A, y_t, r_t, diffusion_t, advection, advection_t);
-        LU(A); FS(A,r); BS(A,r);
-        for (int i=1;i<n-1;i++) y[i]=y[i]-r[i];
+        solveTridiagonal(A,r);
+        for (int i=1;i<n-1;i++) y[i]-=r[i];
         f(m,d,y,y_prev,r, diffusion_t, advection);
     }
 }
@@ -18,6 +18,7 @@ namespace burgersFunction {
     }
     template void primal(std::vector<double> &inout);
     template void primal(std::vector<double_o> &inout);
+    template void primal(std::vector<double_tan<TAD_DIRECTIONS>> &inout);
 
     void primal(checkpoint c, dag *D) {
         std::vector<double_o> inout;
@@ -17,4 +17,12 @@ inline double norm(vector<double>& v) {
     return r;
 }
 
+template<int N>
+inline double norm(vector<double_tan<N>>& v) {
+    int n=v.size();
+    double r=0;
+    for (int i=1;i<n-1;i++) r= r + v[i].getValue()*v[i].getValue();
+    return r;
+}
+
 #endif
\ No newline at end of file
@@ -15,6 +15,7 @@ namespace example1 {
     }
     template void primal(std::vector<double> &inout);
     template void primal(std::vector<double_o> &inout);
+    template void primal(std::vector<double_tan<TAD_DIRECTIONS>> &inout);
 
 
 void primal(checkpoint c, dag* D) {
@@ -35,12 +36,12 @@ void primal(checkpoint c, dag* D) {
 
 
     void primal(checkpoint c, std::function<void(checkpoint)> addCheckpoint) {
-        std::vector<double_o> inout;
+        std::vector<double> inout;
         uint64_t start;
         uint64_t end;
         c.start(inout, start, end);
 
-        double_o u;
+        double u;
         for (uint64_t i = start; i < end; ++i) {
             if (i % windowThreadSize == 0) {
                 checkpoint a = checkpoint(inout, i);
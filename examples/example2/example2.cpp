@@ -4,8 +4,8 @@
 namespace example2 {
 
     template<typename T>
-    void f(T &x1, T &x2, T &y) {
-        T tmp = sin(x2);
+    void f(T &x1, T &x2, T &tmp, T &y) {
+        tmp = sin(x2);
         for (int i = 0; i < size; i++) {
             tmp = x1 + sin(tmp);
         }
@@ -16,10 +16,12 @@ namespace example2 {
 
     template<typename T>
     void primal(std::vector<T> &inout) {
-        f(inout[0], inout[1], inout[0]);
+        // inout[2] holds tmp like in the checkpointed primals, so both leave the same outputs
+        f(inout[0], inout[1], inout[2], inout[0]);
     }
     template void primal(std::vector<double> &inout);
     template void primal(std::vector<double_o> &inout);
+    template void primal(std::vector<double_tan<TAD_DIRECTIONS>> &inout);
 
 
     void primal(checkpoint c, dag* D) {
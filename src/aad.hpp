@@ -12,6 +12,15 @@
 #include <disk/checkpointLoader.hpp>
 #include <memory/checkpointLoader.hpp>
 #include <hybrid/checkpointLoader.hpp>
+#include <tapePool.hpp>
+#include <preaccumulation.hpp>
+#include <levelSchedule.hpp>
+#include <deadTape.hpp>
+#include <retainedTape.hpp>
+#include <sharedStructure.hpp>
+#include <nativeKernel.hpp>
+#include <slotRecycling.hpp>
+#include <mixedPrecision.hpp>
 #include <thread>
 #include "omp.h"
 
@@ -33,10 +42,12 @@ const string debug = DEBUG;
 /**
  * Adjoint Algorithmic Differentiation routine
  * @param in Input vector
- * @param adjoints Adjoint vector, outputs will be placed here
+ * @param adjoints Adjoint vector, outputs will be placed here.
+ * May be empty when retaining the tapes, only the taping is done then.
  * @param totalTime Elapsed aad time in milliseconds, timed using the chrono library
+ * @param retain Optional, keeps all chunk tapes so further seeds can be reversed with retain->reverse()
  */
-void aad(std::vector<double> in, std::vector<double>& adjoints, uint64_t& totalTime) {
+void aad(std::vector<double> in, std::vector<double>& adjoints, uint64_t& totalTime, retainedTape* retain = nullptr) {
 
     /*
      * Copy the Adjoints Vector for Tests later
@@ -72,12 +83,35 @@ void aad(std::vector<double> in, std::vector<double>& adjoints, uint64_t& totalT
     auto stopIdle = std::chrono::high_resolution_clock::now();
     double idleMs = 0;
 
+    /*
+     * Every thread reuses its own tape for all the chunks it processes
+     */
+    tapePool pool(cores);
+    bool reverse = retain == nullptr || !adjoints.empty();
+    if (retain != nullptr) retain->clear();
+
+    /*
+     * The ordered reversal spawns its own threads for level scheduled tapes
+     */
+    if (REVERSAL_THREADS > 1) omp_set_max_active_levels(2);
+
+    /*
+     * Adjoints that may be nonzero, pruned tapes are only valid for this seed so retained tapes are kept whole
+     */
+    std::vector<char> live;
+    bool prune = DEAD_TAPE && retain == nullptr;
+    /*
+     * If the chunk tapes are shared, narrowed and compiled. Decided before the loop, the taping threads must not
+     * read prune while the ordered reversal switches it off.
+     */
+    const bool rewrite = !prune && retain == nullptr;
+
     /*
      * Parallel main aad part
      * Reverse all Chunks, Overload and then Reverse the generated DAG
      * Utilizing OpenMP Multithreading
      */
-#pragma omp parallel for ordered schedule(dynamic, 1) num_threads(cores) default(none) shared(debug, c, size, windowThreadSize, std::cout, adjoints, chunks, startReversal, stopChunkOne, startIdle, stopIdle, idleMs, yAd)
+#pragma omp parallel for ordered schedule(dynamic, 1) num_threads(cores) default(none) shared(debug, c, pool, reverse, retain, live, prune, rewrite, size, windowThreadSize, std::cout, adjoints, chunks, startReversal, stopChunkOne, startIdle, stopIdle, idleMs, yAd)
     for (int64_t i = (int64_t)chunks; i >= 1; --i) {
         if (debug == "Verbose") {
             printf("%d(%d) ", i, omp_get_thread_num());
@@ -91,27 +125,60 @@ void aad(std::vector<double> in, std::vector<double>& adjoints, uint64_t& totalT
         /*
          * Overloading run
          */
-        dag* g = new dag();
+        dag* g = pool.acquire(omp_get_thread_num());
+        double_o::setTape(g);
         primal(check, g);
+        /*
+         * Resolve the tape into its reversal format while still running in parallel
+         */
+        g->finalize();
+        if (RECYCLE_SLOTS) recycleSlots(*g);
+        if (PREACCUMULATE) preaccumulate(*g);
+        if (REVERSAL_THREADS > 1) levelSchedule(*g, REVERSAL_THREADS);
+        /*
+         * Pruned and retained tapes are read record by record, they are neither shared nor narrowed
+         */
+        if (rewrite) {
+            if (SHARE_STRUCTURE || NATIVE_KERNELS) shareStructure(*g);
+            if (MIXED_PRECISION) narrowPartials(*g);
+            if (NATIVE_KERNELS) compileRuns(*g);
+        }
 #pragma omp ordered
         {
             stopIdle = std::chrono::high_resolution_clock::now();
             if (i == (int64_t)chunks) {
                 adjoints.resize(g->getRam(), 0);
                 yAd.resize(g->getRam(), 0);
+                for (auto a : adjoints) {
+                    live.push_back(a != 0);
+                }
                 stopChunkOne = std::chrono::high_resolution_clock::now();
                 startReversal = std::chrono::high_resolution_clock::now();
             } else {
                 idleMs += std::chrono::duration_cast<std::chrono::milliseconds>(stopIdle - startIdle).count();
             }
+            // chunks with recycled adjoint slots may need more of them than the last chunk
+            if (adjoints.size() < (uint64_t)g->getRam()) adjoints.resize(g->getRam(), 0);
             /*
              * Ordered reversal run
              */
-            g->interpret(adjoints);
+            if (prune) {
+                /*
+                 * Once the seed reaches most of the tape the pass costs more than it saves, the remaining chunks are reversed whole
+                 */
+                uint64_t records = g->kinds.size();
+                eliminateDead(*g, live);
+                if (g->kinds.size() * 2 > records) prune = false;
+            }
+            if (reverse) g->interpret(adjoints);
             startIdle = std::chrono::high_resolution_clock::now();
         };
 
-        delete g;
+        if (retain != nullptr) {
+            retain->keep(i, pool.detach(omp_get_thread_num()));
+        } else {
+            pool.release(g);
+        }
     }
     std::cout << std::endl << std::endl;
 
@@ -139,7 +206,7 @@ void aad(std::vector<double> in, std::vector<double>& adjoints, uint64_t& totalT
     /*
      * Optionally run a test if the provided Results are correct
      */
-    if (debug == "Timing") {
+    if (debug == "Timing" && reverse) {
         std::cout << std::endl << "Testing Adjoints:";
         std::cout << std::endl << verifyPercent(in, yAd, adjoints) << " Correct" << std::endl;
     }
@@ -196,13 +263,26 @@ void aadMulti(std::vector<double> in, std::vector<std::vector<double>>& adjoints
     auto stopIdle = std::chrono::high_resolution_clock::now();
     double idleMs = 0;
 
+    /*
+     * All adjoint vectors are reversed together, stored as [position][seed]
+     */
+    int lanes = adjoints.size();
+    std::vector<double> interleaved;
+    std::vector<char> live;
+    bool prune = DEAD_TAPE;
+    const bool rewrite = !prune;
+
+    /*
+     * Every thread reuses its own tape for all the chunks it processes
+     */
+    tapePool pool(cores);
+
     /*
      * Parallel main aad part
      * Reverse all Chunks, Overload and then Reverse the generated DAG
      * Utilizing OpenMP Multithreading
      */
-    omp_set_nested(true);
-#pragma omp parallel for ordered schedule(dynamic, 1) num_threads(cores) default(none) shared(debug, c, size, windowThreadSize, std::cout, adjoints, chunks, startReversal, stopChunkOne, startIdle, stopIdle, idleMs, yAd)
+#pragma omp parallel for ordered schedule(dynamic, 1) num_threads(cores) default(none) shared(debug, c, pool, size, windowThreadSize, std::cout, adjoints, lanes, interleaved, live, prune, rewrite, chunks, startReversal, stopChunkOne, startIdle, stopIdle, idleMs, yAd)
     for (int64_t i = (int64_t)chunks; i >= 1; --i) {
         if (debug == "Verbose") {
             printf("%d(%d) ", i, omp_get_thread_num());
@@ -216,33 +296,57 @@ void aadMulti(std::vector<double> in, std::vector<std::vector<double>>& adjoints
         /*
          * Overloading run
          */
-        dag* g = new dag();
+        dag* g = pool.acquire(omp_get_thread_num());
+        double_o::setTape(g);
         primal(check, g);
+        /*
+         * Resolve the tape into its reversal format while still running in parallel
+         */
+        g->finalize();
+        if (RECYCLE_SLOTS) recycleSlots(*g);
+        if (PREACCUMULATE) preaccumulate(*g);
+        if (SHARE_STRUCTURE && rewrite) shareStructure(*g);
+        if (MIXED_PRECISION && rewrite) narrowPartials(*g);
 
 #pragma omp ordered
         {
             stopIdle = std::chrono::high_resolution_clock::now();
             if (i == (int64_t)chunks) {
-                for (int j = 0; j < adjoints.size(); ++j) {
+                interleaved.resize((uint64_t)g->getRam()*lanes, 0);
+                live.resize(g->getRam(), false);
+                for (int j = 0; j < lanes; ++j) {
                     adjoints[j].resize(g->getRam(), 0);
                     yAd[j].resize(g->getRam(), 0);
+                    for (int k = 0; k < g->getRam(); ++k) {
+                        interleaved[(uint64_t)k*lanes + j] = adjoints[j][k];
+                        if (adjoints[j][k] != 0) live[k] = true;
+                    }
                 }
                 stopChunkOne = std::chrono::high_resolution_clock::now();
                 startReversal = std::chrono::high_resolution_clock::now();
             } else {
                 idleMs += std::chrono::duration_cast<std::chrono::milliseconds>(stopIdle - startIdle).count();
             }
+            // chunks with recycled adjoint slots may need more of them than the last chunk
+            if (interleaved.size() < (uint64_t)g->getRam()*lanes) interleaved.resize((uint64_t)g->getRam()*lanes, 0);
             /*
-             * Ordered reversal run
+             * Ordered reversal run, a single pass over the tape for all adjoint vectors
              */
-            #pragma omp parallel for default (none) shared(adjoints, g)
-            for (int j = 0; j < adjoints.size(); ++j) {
-                g->interpret(adjoints[j]);
+            if (prune) {
+                uint64_t records = g->kinds.size();
+                eliminateDead(*g, live);
+                if (g->kinds.size() * 2 > records) prune = false;
             }
+            g->interpret(interleaved, lanes);
             startIdle = std::chrono::high_resolution_clock::now();
         };
 
-        delete g;
+        pool.release(g);
+    }
+    for (int j = 0; j < lanes; ++j) {
+        for (uint64_t k = 0; k < adjoints[j].size(); ++k) {
+            adjoints[j][k] = interleaved[k*lanes + j];
+        }
     }
     std::cout << std::endl << std::endl;
 
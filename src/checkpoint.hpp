@@ -115,7 +115,8 @@ public:
     }
 
     /**
-     * Starting the Checkpoint without the DAG
+     * Starting the Checkpoint without the DAG, the double_o's are passive. Sweeps without a tape should start on
+     * doubles instead (see start(std::vector<double>&, ...)), passive double_o's still compute partials.
      * @param c will provide the current state of the primal (as overloaded double)
      * @param from will provide the start
      * @param to will provide the to / end
@@ -2,46 +2,816 @@
 #define PROTO_DAG_HPP
 
 #include <cstdint>
+#include <cstring>
 #include <vector>
 #include <iostream>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <functional>
+#include <omp.h>
+#include <tapeAllocator.hpp>
 
-typedef short id;
+/**
+ * Type of the ids the overloaded doubles are recorded with, e.g. short / int / int64_t.
+ * Narrow ids keep the recording compact, wide ids support more persistent variables per primal.
+ * The profiler reports the narrowest type that is safe for a primal.
+ */
+#ifndef TAPE_ID
+#define TAPE_ID short
+#endif
+
+/**
+ * Assignments of one persistent double_o to another alias the source instead of recording a copy edge
+ */
+#ifndef ALIAS_COPIES
+#define ALIAS_COPIES 1
+#endif
+
+/**
+ * Tapes also record the operations of every statement, so they can be re-evaluated on new inputs (see reevaluate.hpp)
+ */
+#ifndef OPCODE_TAPE
+#define OPCODE_TAPE 0
+#endif
+
+/**
+ * Tapes record the linear algebra intrinsics as single records with hand written adjoints (see intrinsics.hpp)
+ */
+#ifndef TAPE_INTRINSICS
+#define TAPE_INTRINSICS 0
+#endif
 
 #ifndef THRESHOLD
 #define THRESHOLD 10000
 #endif
 
+/**
+ * Operation tape, one entry per record of v in recording order plus the guards of branches:
+ * + OP_INPUT, OP_COPY records without a program
+ * + OP_EXPR amount of arguments, program, OP_END
+ * + OP_GUARD outcome, program, OP_END: the comparison value < constant took the branch outcome
+ * Programs are postfix: OP_LEAF argument index, OP_LOAD id (guards), OP_CONST (next value of constants)
+ * and the operations, OP_POW is followed by its exponent, OP_FMA takes three operands.
+ */
+enum opcode : int {
+    OP_INPUT, OP_COPY, OP_EXPR, OP_GUARD, OP_END, OP_LEAF, OP_LOAD, OP_CONST,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_NEG, OP_SIN, OP_COS, OP_POW, OP_FMA
+};
+
 /**
  * This Data-Structure is the main DCG that is then interpreted as a DAG.
  * Uses a custom Datatype to overload operations on double's allowing the code to be overloaded.
  */
-class dag {
+template<typename I>
+class basic_dag {
+public:
+    /**
+     * Position of a record in the reversal tape, an offset into every stream
+     */
+    struct cursor {
+        uint64_t k = 0, t = 0, u = 0, b = 0, n = 0;
+    };
+
+    /**
+     * Native reversal of every repetition of a run (see nativeKernel.hpp)
+     * @param a the adjoints
+     * @param t the partials of the first repetition
+     * @param times amount of repetitions
+     */
+    typedef void (*kernel)(double* a, const double* t, uint64_t times);
+
+    /**
+     * A run of records reversed times times in a row (see sharedStructure.hpp). The streams hold the records once
+     * from start on, the partials of the repetitions follow each other in d from start.t on.
+     * size is the space one repetition takes in every stream, native reverses the run if set.
+     */
+    struct run {
+        cursor start, size;
+        uint64_t times;
+        kernel native = nullptr;
+    };
 private:
-    id counter = 0;
-    id persistent_adjoints = -1;
+    I counter = 0;
+    I persistent_adjoints = -1;
+    I peak = 0;
+
+    /**
+     * Range of ids that can be handed out, adjoint vector offsets are int so wider ids are capped to it
+     */
+    static constexpr int64_t lowestId = std::max<int64_t>(std::numeric_limits<I>::min(), -std::numeric_limits<int>::max());
+    static constexpr int64_t highestId = std::min<int64_t>(std::numeric_limits<I>::max(), std::numeric_limits<int>::max());
+
+    /**
+     * Pending aliases by persistent adjoint: the id a persistent double_o was assigned from (0 if none)
+     * and the persistent double_o's aliasing a persistent id
+     */
+    std::vector<I> aliasOf;
+    std::vector<std::vector<I>> aliasedBy;
+
+    /**
+     * Intrinsic calls recorded but not finalized yet: the ids of their inputs and outputs and their data one call
+     * after the other, the v stream only marks where a call was made
+     */
+    struct pendingCall {
+        int code;
+        uint32_t inputs, outputs;
+        uint64_t data;
+    };
+    std::vector<pendingCall> pendingCalls;
+    tapeVector<I> callIds;
+    tapeVector<double> callData;
+
+    /**
+     * Record the copy target = source
+     */
+    void copy(I target, I source) {
+        if (recordOps) ops.push_back(OP_COPY);
+        v.push_back(source);
+        for (int j = 0; j < scenarios; ++j) {
+            d.push_back(1);
+        }
+        v.push_back(1);
+        v.push_back(target);
+    }
+
+    static void overflow() {
+        throw std::overflow_error("dag: the primal needs more ids than TAPE_ID can hold, build with a wider TAPE_ID");
+    }
+
+    template<typename T>
+    static void writeStream(std::ostream &os, const tapeVector<T> &s) {
+        uint64_t n = s.size();
+        os.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        os.write(reinterpret_cast<const char*>(s.data()), n * sizeof(T));
+    }
+
+    template<typename T>
+    static void readStream(std::istream &is, tapeVector<T> &s) {
+        uint64_t n = 0;
+        is.read(reinterpret_cast<char*>(&n), sizeof(n));
+        s.resize(n);
+        is.read(reinterpret_cast<char*>(s.data()), n * sizeof(T));
+    }
+
+    /**
+     * The reversal reads all streams front to back, spilled streams are read ahead by the kernel
+     */
+    void adviseReversal() const {
+        tapeSpill::advise(d.data(), d.size() * sizeof(double), tapeSpill::SEQUENTIAL);
+        tapeSpill::advise(kinds.data(), kinds.size(), tapeSpill::SEQUENTIAL);
+        tapeSpill::advise(unary.data(), unary.size() * sizeof(int), tapeSpill::SEQUENTIAL);
+        tapeSpill::advise(binary.data(), binary.size() * sizeof(int), tapeSpill::SEQUENTIAL);
+        tapeSpill::advise(nary.data(), nary.size() * sizeof(int), tapeSpill::SEQUENTIAL);
+    }
+
+    /**
+     * finalize() reads the recording backwards, which the kernel does not read ahead.
+     * Fetches the window below the current position while the one above is processed.
+     */
+    struct backwardFetch {
+        static const std::size_t window = 8 * 1024 * 1024;
+        const char* begin;
+        const char* fetched;
+
+        backwardFetch(const tapeVector<I> &s):
+            begin(reinterpret_cast<const char*>(s.data())),
+            fetched(reinterpret_cast<const char*>(s.data() + s.size())) {}
+
+        void operator()(const I* at) {
+            if (reinterpret_cast<const char*>(at) >= fetched + window || fetched == begin) return;
+            const char* from = fetched - begin > (std::ptrdiff_t)window ? fetched - window : begin;
+            tapeSpill::advise(from, fetched - from, tapeSpill::WILLNEED);
+            fetched = from;
+        }
+    };
+
+    /**
+     * Reverse the records of the reversal tape from a cursor up to a record
+     * @param a the adjoints
+     * @param partials the partials, double or float (see narrow())
+     * @param from the first record
+     * @param to the record after the last one
+     */
+    template<typename P>
+    void reverse(double* a, const P* partials, const cursor &from, uint64_t to) const {
+        const uint8_t* k = kinds.data() + from.k;
+        const uint8_t* end = kinds.data() + to;
+        const P* t = partials + from.t;
+        const int* u = unary.data() + from.u;
+        const int* b = binary.data() + from.b;
+        const int* n = nary.data() + from.n;
+
+        for (; k != end; ++k) {
+            switch (*k) {
+                case UNARY: {
+                    double ak = a[u[0]];
+                    a[u[0]] = 0;
+                    a[u[1]] += ak*t[0];
+                    u += 2;
+                    t += 1;
+                    break;
+                }
+                case BINARY: {
+                    double ak = a[b[0]];
+                    a[b[0]] = 0;
+                    a[b[1]] += ak*t[0];
+                    a[b[2]] += ak*t[1];
+                    b += 3;
+                    t += 2;
+                    break;
+                }
+                case UNARY_ADD: {
+                    double ak = a[u[0]];
+                    a[u[0]] = 0;
+                    a[u[1]] += ak;
+                    u += 2;
+                    break;
+                }
+                case UNARY_SUB: {
+                    double ak = a[u[0]];
+                    a[u[0]] = 0;
+                    a[u[1]] -= ak;
+                    u += 2;
+                    break;
+                }
+                case BINARY_ADD: {
+                    double ak = a[b[0]];
+                    a[b[0]] = 0;
+                    a[b[1]] += ak;
+                    a[b[2]] += ak;
+                    b += 3;
+                    break;
+                }
+                case BINARY_SUB: {
+                    double ak = a[b[0]];
+                    a[b[0]] = 0;
+                    a[b[1]] += ak;
+                    a[b[2]] -= ak;
+                    b += 3;
+                    break;
+                }
+                case CALL:
+                    reverseCall(a, 1, n, t);
+                    t += n[3];
+                    n += 4 + n[1] + n[2];
+                    break;
+                default: {
+                    double ak = a[n[0]];
+                    int c = n[1];
+                    a[n[0]] = 0;
+                    for (int i = 0; i < c; ++i) {
+                        a[n[2 + i]] += ak*t[i];
+                    }
+                    n += 2 + c;
+                    t += c;
+                }
+            }
+        }
+    }
+
+    /**
+     * Adjoint of an intrinsic call (see intrinsics.hpp), the adjoints of its outputs are read and zeroed before
+     * the ones of its inputs are incremented
+     * @param lanes amount of adjoints per adjoint vector position, 1 for the scalar reversal
+     * @param n the record in the n-ary stream
+     * @param t the data of the call
+     */
+    template<typename P>
+    void reverseCall(double* a, int lanes, const int* n, const P* t) const {
+        int outputs = n[2];
+        const int* offsets = n + 4;
+        const int* out = offsets + n[1];
+        std::vector<double> w(outputs);
+
+        for (int j = 0; j < lanes; ++j) {
+            for (int i = 0; i < outputs; ++i) {
+                double* r = a + (int64_t)out[i]*lanes + j;
+                w[i] = *r;
+                *r = 0;
+            }
+            // passive inputs have no adjoint
+            auto add = [a, lanes, j](int o, double x) {
+                if (o >= 0) a[(int64_t)o*lanes + j] += x;
+            };
+            switch (n[0]) {
+                case CALL_TRIDIAGONAL: {
+                    // inputs: (sub, diagonal, super) of the rows 1..m, the right hand side b; data: the factors u and l
+                    // (l[0] the sub diagonal entry of row 1), the super diagonal s and the solution x
+                    int m = outputs - 2;
+                    const int* band = offsets;
+                    const int* rhs = offsets + 3 * m;
+                    const P* u = t;
+                    const P* l = t + m;
+                    const P* s = t + 2 * m;
+                    const P* x = t + 3 * m;
+                    // solve T^T w = w: U^T forward, L^T backward, then the rows of the known first and last entry
+                    w[1] = w[1] / u[0];
+                    for (int i = 2; i <= m; ++i) {
+                        w[i] = (w[i] - s[i - 2] * w[i - 1]) / u[i - 1];
+                    }
+                    for (int i = m - 1; i >= 1; --i) {
+                        w[i] -= l[i] * w[i + 1];
+                    }
+                    w[0] -= l[0] * w[1];
+                    w[m + 1] -= s[m - 1] * w[m];
+                    for (int i = 0; i < outputs; ++i) {
+                        add(rhs[i], w[i]);
+                    }
+                    for (int i = 1; i <= m; ++i) {
+                        const int* row = band + 3 * (i - 1);
+                        add(row[0], -w[i] * x[i - 1]);
+                        add(row[1], -w[i] * x[i]);
+                        add(row[2], -w[i] * x[i + 1]);
+                    }
+                    break;
+                }
+                case CALL_EXTERNAL: {
+                    // data: the index of the callback, then the checkpointed inputs
+                    std::vector<double> x(t + 1, t + n[3]), xAdjoint(n[1], 0);
+                    externals[(uint64_t)t[0]](x, w, xAdjoint);
+                    for (int i = 0; i < n[1]; ++i) {
+                        add(offsets[i], xAdjoint[i]);
+                    }
+                    break;
+                }
+                case CALL_AXPY: {
+                    // inputs: x, then y before the update; data: alpha
+                    const int* x = offsets;
+                    const int* y = offsets + outputs;
+                    for (int i = 0; i < outputs; ++i) {
+                        add(y[i], w[i]);
+                        add(x[i], t[0] * w[i]);
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    void reverse(double* a, const cursor &from, uint64_t to) const {
+        if (narrowed != 0) {
+            reverse(a, reinterpret_cast<const float*>(d.data()), from, to);
+        } else {
+            reverse(a, d.data(), from, to);
+        }
+    }
+
+    /**
+     * Reverse a level scheduled tape, every thread reverses its part of a segment, segments are separated by barriers.
+     * Runs serially if no further threads are available (e.g. nested inside the ordered reversal of aad
+     * without nested parallelism), the parts of a segment are then reversed one after the other.
+     */
+    void interpretScheduled(double* a) const {
+        int parallel = partThreads;
+        uint64_t segments = (parts.size() - 1) / parallel;
+#pragma omp parallel num_threads(parallel) default(none) shared(a, parallel, segments)
+        {
+            int team = omp_get_num_threads();
+            int thread = omp_get_thread_num();
+            for (uint64_t s = 0; s < segments; ++s) {
+                for (int j = thread; j < parallel; j += team) {
+                    uint64_t i = s * parallel + j;
+                    reverse(a, parts[i], parts[i + 1].k);
+                }
+#pragma omp barrier
+            }
+        }
+    }
+
+    /**
+     * Vector mode reversal of the records from a cursor up to a record, see interpret(adj, lanes)
+     * @tparam perLane if every edge stores a partial per lane (tapes of scenarios), else all lanes share one
+     */
+    template<typename P, bool perLane>
+    void reverseLanes(double* a, int lanes, const P* partials, const cursor &from, uint64_t to) const {
+        const uint8_t* end = kinds.data() + to;
+        const P* t = partials + from.t;
+        const int* u = unary.data() + from.u;
+        const int* b = binary.data() + from.b;
+        const int* n = nary.data() + from.n;
+
+        for (const uint8_t* it = kinds.data() + from.k; it != end; ++it) {
+            uint8_t k = *it;
+            switch (k) {
+                case UNARY:
+                case UNARY_ADD:
+                case UNARY_SUB: {
+                    double* r = a + (int64_t)u[0]*lanes;
+                    double* x = a + (int64_t)u[1]*lanes;
+                    if (perLane && k == UNARY) {
+#pragma omp simd
+                        for (int j = 0; j < lanes; ++j) {
+                            double ak = r[j];
+                            r[j] = 0;
+                            x[j] += ak*t[j];
+                        }
+                        t += lanes;
+                        u += 2;
+                        break;
+                    }
+                    double p = k == UNARY ? *t++ : *unitPartials(k);
+#pragma omp simd
+                    for (int j = 0; j < lanes; ++j) {
+                        double ak = r[j];
+                        r[j] = 0;
+                        x[j] += ak*p;
+                    }
+                    u += 2;
+                    break;
+                }
+                case BINARY:
+                case BINARY_ADD:
+                case BINARY_SUB: {
+                    double* r = a + (int64_t)b[0]*lanes;
+                    double* x = a + (int64_t)b[1]*lanes;
+                    double* y = a + (int64_t)b[2]*lanes;
+                    if (perLane && k == BINARY) {
+                        const P* q = t + lanes;
+#pragma omp simd
+                        for (int j = 0; j < lanes; ++j) {
+                            double ak = r[j];
+                            r[j] = 0;
+                            x[j] += ak*t[j];
+                            y[j] += ak*q[j];
+                        }
+                        t += 2 * lanes;
+                        b += 3;
+                        break;
+                    }
+                    double p = k == BINARY ? t[0] : unitPartials(k)[0];
+                    double q = k == BINARY ? t[1] : unitPartials(k)[1];
+                    if (k == BINARY) t += 2;
+#pragma omp simd
+                    for (int j = 0; j < lanes; ++j) {
+                        double ak = r[j];
+                        r[j] = 0;
+                        x[j] += ak*p;
+                        y[j] += ak*q;
+                    }
+                    b += 3;
+                    break;
+                }
+                case CALL:
+                    reverseCall(a, lanes, n, t);
+                    t += n[3];
+                    n += 4 + n[1] + n[2];
+                    break;
+                default: {
+                    double* r = a + (int64_t)n[0]*lanes;
+                    int c = n[1];
+                    // the partial of argument i in lane j is q[i*width]
+                    int width = perLane ? lanes : 1;
+                    for (int j = 0; j < lanes; ++j) {
+                        double ak = r[j];
+                        r[j] = 0;
+                        const P* q = perLane ? t + j : t;
+                        for (int i = 0; i < c; ++i) {
+                            a[(int64_t)n[2 + i]*lanes + j] += ak*q[i*width];
+                        }
+                    }
+                    n += 2 + c;
+                    t += c * width;
+                }
+            }
+        }
+    }
+
+    void reverseLanes(double* a, int lanes, const cursor &from, uint64_t to) const {
+        if (scenarios > 1) {
+            reverseLanes<double, true>(a, lanes, d.data(), from, to);
+        } else if (narrowed != 0) {
+            reverseLanes<float, false>(a, lanes, reinterpret_cast<const float*>(d.data()), from, to);
+        } else {
+            reverseLanes<double, false>(a, lanes, d.data(), from, to);
+        }
+    }
+
+    /**
+     * Reverse a tape sharing structure run by run, every repetition reads the shared records with its own partials
+     * @param lanes amount of seeds, 0 for the scalar reversal
+     */
+    void reverseRuns(double* a, int lanes) const {
+        for (auto &r : runs) {
+            if (lanes == 0 && r.native != nullptr && narrowed == 0) {
+                r.native(a, d.data() + r.start.t, r.times);
+                continue;
+            }
+            cursor c = r.start;
+            for (uint64_t i = 0; i < r.times; ++i) {
+                if (lanes == 0) {
+                    reverse(a, c, r.start.k + r.size.k);
+                } else {
+                    reverseLanes(a, lanes, c, r.start.k + r.size.k);
+                }
+                c.t += r.size.t;
+            }
+        }
+    }
 public:
     /**
-     * Contains a list of derivatives in order of overloading
+     * Record kinds of the reversal tape, a record is sorted into the stream matching its arity.
+     * Unary and binary records whose partials are all +1 / -1 (sums, differences, copies) store no partials,
+     * they are reversed as plain additions and subtractions. BINARY_SUB stores the argument added to first.
+     * CALL records are intrinsic calls with several outputs, stored in the n-ary stream as
+     * (intrinsic, amount of inputs, amount of outputs, amount of data, inputs..., outputs...), their data is in d.
+     */
+    enum kind : uint8_t { UNARY = 1, BINARY = 2, NARY = 3, UNARY_ADD = 4, UNARY_SUB = 5, BINARY_ADD = 6, BINARY_SUB = 7, CALL = 8 };
+
+    /**
+     * The intrinsics a CALL record reverses (see intrinsics.hpp)
+     */
+    enum intrinsic { CALL_TRIDIAGONAL = 0, CALL_AXPY = 1, CALL_EXTERNAL = 2 };
+
+    /**
+     * Adjoint of an external function (see externalFunction.hpp), called once per lane during the reversal
+     * @param x the checkpointed inputs, empty if they were not checkpointed
+     * @param yAdjoint the adjoints of the outputs
+     * @param xAdjoint the adjoints of the inputs, zero on entry, added to the adjoint vector afterwards
+     */
+    typedef std::function<void(const std::vector<double> &x, const std::vector<double> &yAdjoint,
+                               std::vector<double> &xAdjoint)> externalAdjoint;
+
+    /**
+     * Id of a passive input of an intrinsic call, never handed out by getId(). It is stored as adjoint vector offset -1.
+     */
+    static constexpr I passiveId = lowestId;
+
+    /**
+     * Partials of the records stored without them, UNARY_ADD / BINARY_ADD {1, 1}, BINARY_SUB {1, -1}, UNARY_SUB {-1}
+     */
+    static constexpr double units[3] = {1, 1, -1};
+
+    static const double* unitPartials(uint8_t k) {
+        return k == UNARY_SUB ? units + 2 : (k == BINARY_SUB ? units + 1 : units);
+    }
+
+    /**
+     * @return the kind a record with these partials is stored as
+     */
+    static uint8_t kindOf(int c, const double* p) {
+        if (c == 1) {
+            return p[0] == 1 ? UNARY_ADD : (p[0] == -1 ? UNARY_SUB : UNARY);
+        }
+        if (c == 2) {
+            if (p[0] == 1 && p[1] == 1) return BINARY_ADD;
+            if ((p[0] == 1 && p[1] == -1) || (p[0] == -1 && p[1] == 1)) return BINARY_SUB;
+            return BINARY;
+        }
+        return NARY;
+    }
+
+    /**
+     * @return the kind a record with the partials of several scenarios is stored as, unit records need the same
+     * partials in every scenario
+     * @param p the partials of every scenario per argument
+     */
+    static uint8_t kindOf(int c, const double* p, int scenarios) {
+        double first[2];
+        for (int i = 0; i < c && i < 2; ++i) {
+            first[i] = p[i * scenarios];
+            for (int j = 1; j < scenarios; ++j) {
+                if (p[i * scenarios + j] != first[i]) return c == 1 ? UNARY : (c == 2 ? BINARY : NARY);
+            }
+        }
+        return c <= 2 ? kindOf(c, first) : (uint8_t)NARY;
+    }
+
+    /**
+     * Add the space a record takes in every stream to a cursor
      */
-    std::vector<double> d;
+    static void measure(cursor &s, int c, const double* p) {
+        uint8_t k = kindOf(c, p);
+        s.k += 1;
+        if (k <= NARY) s.t += c;
+        if (c == 1) s.u += 2;
+        else if (c == 2) s.b += 3;
+        else s.n += 2 + c;
+    }
+
+    /**
+     * Store a record at a cursor of the reversal tape and move the cursor behind it, the streams have to be large enough.
+     * The cursor may trail the record that is stored (in place compaction of a tape).
+     * @param at where to store the record
+     * @param res adjoint vector offset of the result
+     * @param c amount of arguments
+     * @param args adjoint vector offsets of the arguments
+     * @param p derivatives in direction of the arguments, the ones of every scenario per argument
+     */
+    void place(cursor &at, int res, int c, const int* args, const double* p) {
+        uint8_t k = scenarios > 1 ? kindOf(c, p, scenarios) : kindOf(c, p);
+        kinds[at.k++] = k;
+        if (c == 1) {
+            unary[at.u++] = res;
+            unary[at.u++] = args[0];
+        } else if (c == 2) {
+            int first = k == BINARY_SUB && p[0] == -1;
+            int a0 = args[first], a1 = args[1 - first];
+            binary[at.b++] = res;
+            binary[at.b++] = a0;
+            binary[at.b++] = a1;
+        } else {
+            nary[at.n++] = res;
+            nary[at.n++] = c;
+            for (int i = 0; i < c; ++i) {
+                nary[at.n++] = args[i];
+            }
+        }
+        if (k <= NARY) {
+            for (int i = 0; i < c * scenarios; ++i) {
+                d[at.t++] = p[i];
+            }
+        }
+    }
+
+    /**
+     * Contains a list of derivatives in order of overloading.
+     * After finalize() the list is flipped and holds the derivatives in order of reversal.
+     */
+    tapeVector<double> d;
     /**
      * Contains the dag interpreted in reverse containing the identifier of the node then the
      * amount of nodes pointing at it, followed by a list of said nodes.
+     * This is the recording format, it is emptied by finalize().
      */
-    std::vector<id> v;
+    tapeVector<I> v;
     /**
      * The current bandwidth (vector size) needed for adjoint reversal
      */
     int bandwidth = 1;
 
-    dag() = default;
+    /**
+     * The reversal tape, built by finalize() from v.
+     * All streams are stored in order of reversal and contain adjoint vector offsets instead of ids,
+     * so the reversal is a single forward walk over every stream.
+     */
+    tapeVector<uint8_t> kinds;
+    /**
+     * Unary records as (result, argument)
+     */
+    tapeVector<int> unary;
+    /**
+     * Binary records as (result, argument, argument)
+     */
+    tapeVector<int> binary;
+    /**
+     * N-ary records as (result, amount of arguments, arguments...)
+     */
+    tapeVector<int> nary;
+    /**
+     * True once the recording was turned into the reversal tape
+     */
+    bool finalized = false;
+    /**
+     * Length of v when it was finalized, v itself is emptied by finalize()
+     */
+    uint64_t recorded = 0;
+
+    /**
+     * Adjoint vector offsets of the registered inputs, collected by finalize()
+     */
+    std::vector<int> inputs;
+
+    /**
+     * Level schedule of the reversal tape (see levelSchedule.hpp), empty if the tape is reversed by one thread.
+     * The tape is split into segments of partThreads parts each, the parts of a segment touch distinct adjoints
+     * and are reversed concurrently. parts holds the start of every part followed by the end of the tape.
+     */
+    std::vector<cursor> parts;
+    int partThreads = 0;
+
+    /**
+     * Amount of partials if d stores them as float (see narrow()), 0 if d stores doubles
+     */
+    uint64_t narrowed = 0;
+
+    /**
+     * Partials per edge, a tape recorded by double_l<N> stores the partials of its N scenarios next to each other
+     * (see double_l.hpp). It is reversed for all scenarios at once, the passes leave it as it is.
+     */
+    int scenarios = 1;
+
+    /**
+     * Amount of intrinsic calls (CALL records, see intrinsics.hpp) of the tape. The passes rewriting the reversal tape
+     * record by record leave a tape with calls as it is.
+     */
+    uint64_t calls = 0;
+    /**
+     * Adjoints of the external functions of the tape, CALL_EXTERNAL records hold their index
+     */
+    std::vector<externalAdjoint> externals;
+
+    /**
+     * Shared structure of the reversal tape (see sharedStructure.hpp), empty if every record is stored.
+     * The runs cover the tape in order of reversal, unshared holds the lengths of the streams without sharing.
+     */
+    std::vector<run> runs;
+    cursor unshared;
+
+    /**
+     * Operation tape (see opcode) and the constants of its programs, only recorded if recordOps is set.
+     * A tape recording operations keeps v after finalize(), reevaluate() needs it.
+     */
+    tapeVector<int> ops;
+    tapeVector<double> constants;
+    bool recordOps = OPCODE_TAPE;
+    /**
+     * If intrinsics are recorded as single records (see intrinsics.hpp), otherwise they are recorded elementwise
+     */
+    bool recordIntrinsics = TAPE_INTRINSICS;
+    /**
+     * True once a pass rewrote the reversal tape, its records no longer match the recording one by one
+     */
+    bool rewritten = false;
+
+    /**
+     * Lengths of all tape streams, used to pre-size reused tapes
+     */
+    struct sizes {
+        uint64_t v = 0, d = 0, kinds = 0, unary = 0, binary = 0, nary = 0;
+    };
+
+    basic_dag() = default;
+
+    /**
+     * @return the current lengths of all tape streams
+     */
+    sizes getSizes() const {
+        sizes s;
+        s.v = finalized ? recorded : v.size();
+        s.d = narrowed != 0 ? narrowed : d.size();
+        s.kinds = runs.empty() ? kinds.size() : unshared.k;
+        s.unary = runs.empty() ? unary.size() : unshared.u;
+        s.binary = runs.empty() ? binary.size() : unshared.b;
+        s.nary = runs.empty() ? nary.size() : unshared.n;
+        return s;
+    }
+
+    /**
+     * Pre-size all tape streams, avoids reallocations while taping
+     * @param s expected lengths of the tape streams
+     */
+    void reserve(const sizes &s) {
+        v.reserve(s.v);
+        d.reserve(s.d);
+        kinds.reserve(s.kinds);
+        unary.reserve(s.unary);
+        binary.reserve(s.binary);
+        nary.reserve(s.nary);
+    }
+
+    /**
+     * Release all memory the tape streams hold beyond their length, used for tapes that are kept
+     */
+    void shrink() {
+        v.shrink_to_fit();
+        d.shrink_to_fit();
+        kinds.shrink_to_fit();
+        unary.shrink_to_fit();
+        binary.shrink_to_fit();
+        nary.shrink_to_fit();
+    }
+
+    /**
+     * Empty the tape so it can record the next chunk, the memory of all streams is kept
+     */
+    void reset() {
+        counter = 0;
+        persistent_adjoints = -1;
+        peak = 0;
+        bandwidth = 1;
+        finalized = false;
+        recorded = 0;
+        aliasOf.clear();
+        aliasedBy.clear();
+        inputs.clear();
+        parts.clear();
+        partThreads = 0;
+        runs.clear();
+        narrowed = 0;
+        scenarios = 1;
+        calls = 0;
+        externals.clear();
+        pendingCalls.clear();
+        callIds.clear();
+        callData.clear();
+        rewritten = false;
+        v.clear();
+        ops.clear();
+        constants.clear();
+        d.clear();
+        kinds.clear();
+        unary.clear();
+        binary.clear();
+        nary.clear();
+    }
 
     /**
      * Transform real id -> adjoint vector position
      * @param id the overloaded double id
      * @return the real position it has on the adjoint vector
      */
-    int adjoint_id(id id) const {
+    int adjoint_id(I id) const {
         if (id < 0) return -id-1;
         return id % bandwidth - persistent_adjoints - 1;
     }
@@ -54,51 +824,572 @@ public:
         return bandwidth - persistent_adjoints - 1;
     }
 
+    /**
+     * Amount of persistent adjoints, they occupy the front of the adjoint vector.
+     * All adjoint vector positions behind them belong to temporaries of this tape.
+     * @return amount of persistent adjoints
+     */
+    int getPersistent() const {
+        return -persistent_adjoints - 1;
+    }
+
+    /**
+     * Set the layout of the adjoint vector after a pass renumbered the offsets of the reversal tape (see slotRecycling.hpp),
+     * adjoint_id() no longer resolves the recorded ids then
+     * @param persistent amount of adjoints at the front of the adjoint vector that keep their offsets
+     * @param ram size of the adjoint vector
+     */
+    void renumbered(int persistent, int ram) {
+        persistent_adjoints = -(I)persistent - 1;
+        bandwidth = std::max(ram - persistent, 1);
+    }
+
+    /**
+     * The id a read of a double_o is recorded with, aliased persistent double_o's are read from their source
+     * @param id the id of the double_o
+     */
+    I resolve(I id) const {
+        if (id < 0 && (uint64_t)(-id-1) < aliasOf.size() && aliasOf[-id-1] != 0) return aliasOf[-id-1];
+        return id;
+    }
+
+    /**
+     * Copy propagation of an assignment between persistent double_o's, instead of recording the copy
+     * the target is read from the source until one of them is overwritten
+     * @param target the persistent id assigned to
+     * @param source the persistent id assigned from
+     */
+    void alias(I target, I source) {
+        source = resolve(source);
+        if (source == target) return;
+        uint64_t t = -target-1, s = -source-1;
+        uint64_t needed = std::max(t, s) + 1;
+        if (aliasOf.size() < needed) {
+            aliasOf.resize(needed, 0);
+            aliasedBy.resize(needed);
+        }
+        aliasOf[t] = source;
+        aliasedBy[s].push_back(target);
+    }
+
+    /**
+     * Has to be called before the arguments of an operation overwriting a persistent id are recorded.
+     * Double_o's aliasing the current value of the id get their copy recorded now.
+     * @param id the persistent id that is overwritten
+     */
+    void overwrite(I id) {
+        uint64_t slot = -id-1;
+        if (id >= 0 || slot >= aliasOf.size()) return;
+        for (I target : aliasedBy[slot]) {
+            if (aliasOf[-target-1] == id) {
+                copy(target, id);
+                aliasOf[-target-1] = 0;
+            }
+        }
+        aliasedBy[slot].clear();
+    }
+
+    /**
+     * Has to be called once a persistent id is recorded as the result of an operation, ends its own alias.
+     * The arguments of the operation still read the aliased source.
+     * @param id the persistent id that was overwritten
+     */
+    void unalias(I id) {
+        uint64_t slot = -id-1;
+        if (id < 0 && slot < aliasOf.size()) aliasOf[slot] = 0;
+    }
+
     /**
      * Used by overloaded double type for the next id
      * @param c if the double_o is a left side (true / persistent) or right side (false / non persistent)
      * @return the id given to this new overloaded double
      */
-    id getId(bool c) {
+    I getId(bool c) {
         if (c) {
+            if (persistent_adjoints == lowestId) overflow();
             return persistent_adjoints--;
         } else {
             /*
-             * The number 10000 is chosen arbitrarily by the programmer (Yannik Hesse),
-             * although there are primals which this might cause conflicts with, the general idea is
-             * that no singular expression should contain more than 10000 elemental operations (lol)
-             * The reason this is done, is to support extremely large tapes with ease and not be limited to the size of
-             * a short (id). Solutions choosing an int or int64_t as a counter type are found not to be sufficiently scalable and
-             * cause significant additional load on the memory. If there is any real need to extend the persistent memory, as in there
-             * is a primal that uses more than 65.000 distinct variables changing the id datatype from short to int is an easy step.
+             * Temporary ids are recycled once THRESHOLD ids were handed out, the adjoint positions of
+             * temporaries repeat every bandwidth ids. The assumption is that no singular expression
+             * contains more than THRESHOLD elemental operations.
              */
             if (counter >= THRESHOLD + bandwidth && counter % bandwidth == 0) {
                 counter = 0;
             }
+            if (counter == highestId) overflow();
+            if (counter > peak) peak = counter;
             return counter++;
         }
     }
 
     /**
-     * Interpret the DCG by reversing all Nodes and Edges. An Adjoint vector is needed with at least the size of
-     * the bandwidth to successfully interpret the DAG
-     * @param adj Vector of Adjoints at least the size of the current bandwidth
+     * Narrowest id width that holds all ids handed out by this tape so far
+     * @return the size of the id type in bytes (2, 4 or 8)
      */
-    void interpret(std::vector<double> &adj) {
-        auto it = v.rbegin();
-        auto it2 = d.rbegin();
+    int requiredIdBytes() const {
+        int64_t ids = std::max<int64_t>(getPersistent(), peak) + 1;
+        if (ids < std::numeric_limits<int16_t>::max()) return 2;
+        if (ids < std::numeric_limits<int32_t>::max()) return 4;
+        return 8;
+    }
+
+    /**
+     * Record an intrinsic call (see intrinsics.hpp), reversed by its hand written adjoint instead of elementwise
+     * @param code the intrinsic, see intrinsic
+     * @param ids the ids of the inputs followed by the ones of the outputs, passiveId for passive inputs
+     * @param inputs amount of inputs
+     * @param outputs amount of outputs
+     * @param data what the adjoint of the intrinsic reads, stored like partials
+     * @param q amount of data
+     */
+    void recordCall(int code, const I* ids, int inputs, int outputs, const double* data, uint64_t q) {
+        pendingCalls.push_back(pendingCall{code, (uint32_t)inputs, (uint32_t)outputs, q});
+        callIds.insert(callIds.end(), ids, ids + inputs + outputs);
+        callData.insert(callData.end(), data, data + q);
+        v.push_back(-1);
+        v.push_back(0);
+    }
+
+    /**
+     * Turn the recorded v into the reversal tape. Resolves every id to its adjoint vector offset exactly once,
+     * drops the input registrations (they carry no edges) and sorts the records by arity.
+     * Has to be called after the recording is complete, as the offsets depend on the final bandwidth and
+     * amount of persistent adjoints. Calling it on the taping thread keeps this work away from the reversal.
+     */
+    void finalize() {
+        if (finalized) return;
 
-        while(it != v.rend()) {
+        // aliases still pending at the end of the chunk read the final value of their source
+        for (uint64_t slot = 0; slot < aliasOf.size(); ++slot) {
+            if (aliasOf[slot] != 0) copy(-(I)slot-1, aliasOf[slot]);
+        }
+        aliasOf.clear();
+        aliasedBy.clear();
+
+        bool spilled = tapeSpill::active();
+        uint64_t records = 0, unaries = 0, binaries = 0, naries = 0;
+        backwardFetch counting(v);
+        for (auto it = v.rbegin(); it != v.rend(); it += 2 + std::max(*(it + 1), (I)0)) {
+            if (spilled) counting(&*it);
+            int c = *(it + 1);
+            if (c != 0) records++;
+            if (c == UNARY) unaries++;
+            else if (c == BINARY) binaries++;
+            else if (c > 0) naries += 2 + c;
+        }
+        for (auto &call : pendingCalls) {
+            naries += 4 + call.inputs + call.outputs;
+        }
+        cursor at;
+        at.k = kinds.size();
+        at.u = unary.size();
+        at.b = binary.size();
+        at.n = nary.size();
+        kinds.resize(at.k + records);
+        unary.resize(at.u + 2 * unaries);
+        binary.resize(at.b + 3 * binaries);
+        nary.resize(at.n + naries);
+
+        // the partials are compacted in place, partials of unit records are dropped.
+        // The edges are flipped, the partials of the scenarios of an edge keep their order
+        std::reverse(d.begin(), d.end());
+        if (scenarios > 1) {
+            for (auto e = d.begin(); e != d.end(); e += scenarios) {
+                std::reverse(e, e + scenarios);
+            }
+        }
+        // the data of calls can outgrow the partials that are dropped, a tape with calls is not compacted in place
+        tapeVector<double> source;
+        if (!pendingCalls.empty()) {
+            source.swap(d);
+            d.resize(source.size() + callData.size());
+        }
+        const double* partials = pendingCalls.empty() ? d.data() : source.data();
+        uint64_t read = 0;
+        uint64_t idsLeft = callIds.size(), dataLeft = callData.size();
+        auto call = pendingCalls.rbegin();
+        std::vector<int> args;
+
+        backwardFetch fetch(v);
+        auto it = v.rbegin();
+        while (it != v.rend()) {
+            if (spilled) fetch(&*it);
             int idx = adjoint_id(*it++);
             int c = *it++;
-            double ak = adj[idx];
-            if (c != 0) adj[idx] = 0;
+            if (c == 0) {
+                inputs.push_back(idx);
+                continue;
+            }
+            if (c < 0) {
+                int ids = call->inputs + call->outputs;
+                idsLeft -= ids;
+                dataLeft -= call->data;
+                kinds[at.k++] = CALL;
+                nary[at.n++] = call->code;
+                nary[at.n++] = call->inputs;
+                nary[at.n++] = call->outputs;
+                nary[at.n++] = call->data;
+                for (int i = 0; i < ids; ++i) {
+                    I id = callIds[idsLeft + i];
+                    nary[at.n++] = id == passiveId ? -1 : adjoint_id(id);
+                }
+                std::copy(callData.begin() + dataLeft, callData.begin() + dataLeft + call->data, d.begin() + at.t);
+                at.t += call->data;
+                ++call;
+                continue;
+            }
+            if ((int)args.size() < c) args.resize(c);
             for (int i = 0; i < c; ++i) {
-                int id2 = adjoint_id(*it++);
-                double t = *it2++;
-                adj[id2] += ak*t;
+                args[i] = adjoint_id(*it++);
+            }
+            place(at, idx, c, args.data(), partials + read);
+            read += (uint64_t)c * scenarios;
+        }
+        d.resize(at.t);
+        calls += pendingCalls.size();
+        pendingCalls.clear();
+        callIds.clear();
+        callData.clear();
+        recorded = v.size();
+        if (!recordOps) v.clear();
+        finalized = true;
+    }
+
+    /**
+     * Rebuild the reversal tape of a tape that recorded its operations from new partials, passes that rewrote
+     * the reversal tape (preaccumulation, level schedule, dead tape elimination) have to be run again
+     * @param partials the derivatives of every record in order of recording
+     */
+    void rebuild(const std::vector<double> &partials) {
+        kinds.clear();
+        unary.clear();
+        binary.clear();
+        nary.clear();
+        inputs.clear();
+        parts.clear();
+        partThreads = 0;
+        runs.clear();
+        narrowed = 0;
+        rewritten = false;
+        d.assign(partials.begin(), partials.end());
+        finalized = false;
+        finalize();
+    }
+
+    /**
+     * Store the partials as float in the first half of d (mixed precision, see mixedPrecision.hpp), the reversal
+     * still accumulates the adjoints in double. Passes that read or rewrite the partials call widen() first.
+     */
+    void narrow() {
+        if (narrowed != 0 || d.empty()) return;
+        uint64_t n = d.size();
+        // in place, every float is written behind the doubles that were read
+        char* bytes = reinterpret_cast<char*>(d.data());
+        for (uint64_t i = 0; i < n; ++i) {
+            double x;
+            std::memcpy(&x, bytes + 8 * i, 8);
+            float f = (float)x;
+            std::memcpy(bytes + 4 * i, &f, 4);
+        }
+        d.resize((n + 1) / 2);
+        d.shrink_to_fit();
+        narrowed = n;
+    }
+
+    /**
+     * Store float partials (see narrow()) as doubles again
+     */
+    void widen() {
+        if (narrowed == 0) return;
+        uint64_t n = narrowed;
+        d.resize(n);
+        char* bytes = reinterpret_cast<char*>(d.data());
+        for (uint64_t i = n; i-- > 0;) {
+            float f;
+            std::memcpy(&f, bytes + 4 * i, 4);
+            double x = f;
+            std::memcpy(bytes + 8 * i, &x, 8);
+        }
+        narrowed = 0;
+    }
+
+    /**
+     * Store every repetition of the shared runs again (see sharedStructure.hpp), passes that read or rewrite
+     * the records one by one call it first
+     */
+    void unshare() {
+        if (runs.empty()) return;
+        tapeVector<uint8_t> k(unshared.k);
+        tapeVector<int> u(unshared.u), b(unshared.b), n(unshared.n);
+        cursor w;
+        for (auto &r : runs) {
+            for (uint64_t i = 0; i < r.times; ++i) {
+                std::copy(kinds.begin() + r.start.k, kinds.begin() + r.start.k + r.size.k, k.begin() + w.k);
+                std::copy(unary.begin() + r.start.u, unary.begin() + r.start.u + r.size.u, u.begin() + w.u);
+                std::copy(binary.begin() + r.start.b, binary.begin() + r.start.b + r.size.b, b.begin() + w.b);
+                std::copy(nary.begin() + r.start.n, nary.begin() + r.start.n + r.size.n, n.begin() + w.n);
+                w.k += r.size.k;
+                w.u += r.size.u;
+                w.b += r.size.b;
+                w.n += r.size.n;
             }
         }
+        kinds.swap(k);
+        unary.swap(u);
+        binary.swap(b);
+        nary.swap(n);
+        runs.clear();
+    }
+
+    /**
+     * Visit every record of the reversal tape in order of reversal, the tape must neither share structure nor
+     * store float partials (see unshare(), widen()) nor contain intrinsic calls
+     * @param f called as f(result, amount of arguments, arguments, derivatives)
+     */
+    template<typename F>
+    void forEach(F f) const {
+        const double* t = d.data();
+        const int* u = unary.data();
+        const int* b = binary.data();
+        const int* n = nary.data();
+
+        for (uint8_t k : kinds) {
+            switch (k) {
+                case UNARY:
+                    f(u[0], 1, u + 1, t);
+                    u += 2;
+                    t += 1;
+                    break;
+                case BINARY:
+                    f(b[0], 2, b + 1, t);
+                    b += 3;
+                    t += 2;
+                    break;
+                case UNARY_ADD:
+                case UNARY_SUB:
+                    f(u[0], 1, u + 1, unitPartials(k));
+                    u += 2;
+                    break;
+                case BINARY_ADD:
+                case BINARY_SUB:
+                    f(b[0], 2, b + 1, unitPartials(k));
+                    b += 3;
+                    break;
+                default: {
+                    // read before f, records may be rewritten in place behind the visited one
+                    int c = n[1];
+                    f(n[0], c, n + 2, t);
+                    t += c;
+                    n += 2 + c;
+                }
+            }
+        }
+    }
+
+    /**
+     * Visit every record of the reversal tape in order of overloading, as forEach()
+     * @param f called as f(result, amount of arguments, arguments, derivatives)
+     */
+    template<typename F>
+    void forEachForward(F f) const {
+        // n-ary records can only be read front to back
+        std::vector<uint64_t> naries;
+        for (uint64_t i = 0; i < nary.size(); i += 2 + nary[i + 1]) {
+            naries.push_back(i);
+        }
+
+        const double* t = d.data() + d.size();
+        const int* u = unary.data() + unary.size();
+        const int* b = binary.data() + binary.size();
+        auto n = naries.rbegin();
+
+        for (auto k = kinds.rbegin(); k != kinds.rend(); ++k) {
+            switch (*k) {
+                case UNARY:
+                    u -= 2;
+                    t -= 1;
+                    f(u[0], 1, u + 1, t);
+                    break;
+                case BINARY:
+                    b -= 3;
+                    t -= 2;
+                    f(b[0], 2, b + 1, t);
+                    break;
+                case UNARY_ADD:
+                case UNARY_SUB:
+                    u -= 2;
+                    f(u[0], 1, u + 1, unitPartials(*k));
+                    break;
+                case BINARY_ADD:
+                case BINARY_SUB:
+                    b -= 3;
+                    f(b[0], 2, b + 1, unitPartials(*k));
+                    break;
+                default: {
+                    const int* r = nary.data() + *n++;
+                    t -= r[1];
+                    f(r[0], r[1], r + 2, t);
+                }
+            }
+        }
+    }
+
+    /**
+     * Append a record to the end of the reversal tape (it will be reversed after all present records),
+     * used by passes that rewrite a finalized tape
+     * @param res adjoint vector offset of the result
+     * @param c amount of arguments
+     * @param args adjoint vector offsets of the arguments
+     * @param partials derivatives in direction of the arguments
+     */
+    void append(int res, int c, const int* args, const double* partials) {
+        if (c == 0) return;
+        cursor at;
+        at.k = kinds.size();
+        at.t = d.size();
+        at.u = unary.size();
+        at.b = binary.size();
+        at.n = nary.size();
+        cursor end = at;
+        measure(end, c, partials);
+        kinds.resize(end.k);
+        d.resize(end.t);
+        unary.resize(end.u);
+        binary.resize(end.b);
+        nary.resize(end.n);
+        place(at, res, c, args, partials);
+    }
+
+    /**
+     * Exchange the reversal tape with the one of another dag, used by passes that rewrite a finalized tape
+     * @param o the dag holding the rewritten tape
+     */
+    void swapReversal(basic_dag &o) {
+        d.swap(o.d);
+        kinds.swap(o.kinds);
+        unary.swap(o.unary);
+        binary.swap(o.binary);
+        nary.swap(o.nary);
+        parts.swap(o.parts);
+        std::swap(partThreads, o.partThreads);
+        runs.swap(o.runs);
+        std::swap(unshared, o.unshared);
+        std::swap(narrowed, o.narrowed);
+        rewritten = true;
+    }
+
+    /**
+     * Move a cursor to the next record of the reversal tape
+     */
+    void advance(cursor &c) const {
+        switch (kinds[c.k++]) {
+            case UNARY:
+                c.u += 2;
+                c.t += scenarios;
+                break;
+            case BINARY:
+                c.b += 3;
+                c.t += 2 * scenarios;
+                break;
+            case UNARY_ADD:
+            case UNARY_SUB:
+                c.u += 2;
+                break;
+            case BINARY_ADD:
+            case BINARY_SUB:
+                c.b += 3;
+                break;
+            case CALL:
+                c.t += nary[c.n + 3];
+                c.n += 4 + nary[c.n + 1] + nary[c.n + 2];
+                break;
+            default:
+                c.t += (uint64_t)nary[c.n + 1] * scenarios;
+                c.n += 2 + nary[c.n + 1];
+        }
+    }
+
+    /**
+     * Interpret the DCG by reversing all Nodes and Edges. An Adjoint vector is needed with at least the size of
+     * the bandwidth to successfully interpret the DAG
+     * @param adj Vector of Adjoints at least the size of the current bandwidth, tapes of scenarios are reversed
+     * as interpret(adj, scenarios)
+     */
+    void interpret(std::vector<double> &adj) {
+        if (scenarios > 1) {
+            interpret(adj, scenarios);
+            return;
+        }
+        finalize();
+        adviseReversal();
+
+        if (!runs.empty()) {
+            reverseRuns(adj.data(), 0);
+        } else if (partThreads > 1) {
+            interpretScheduled(adj.data());
+        } else {
+            reverse(adj.data(), cursor(), kinds.size());
+        }
+    }
+
+    /**
+     * Vector mode interpretation, reverses the DCG for several adjoint seeds (lanes) in a single pass.
+     * The adjoints of one adjoint vector position are stored next to each other so every edge
+     * becomes one fused multiply add over all lanes.
+     * @param adj Adjoints laid out as [position][lane], at least the size of getRam()*lanes
+     * @param lanes The amount of seeds propagated at once, the amount of scenarios for a tape of scenarios
+     */
+    void interpret(std::vector<double> &adj, int lanes) {
+        if (scenarios > 1 && lanes != scenarios) {
+            throw std::invalid_argument("a tape of scenarios is reversed with one lane per scenario");
+        }
+        finalize();
+        adviseReversal();
+
+        if (!runs.empty()) {
+            reverseRuns(adj.data(), lanes);
+        } else {
+            reverseLanes(adj.data(), lanes, cursor(), kinds.size());
+        }
+    }
+
+    /**
+     * Write the finalized tape in a binary format, used to move tapes out of memory
+     * @param os binary output stream
+     */
+    void write(std::ostream &os) {
+        if (scenarios > 1) throw std::invalid_argument("tapes of scenarios are not written");
+        if (!externals.empty()) throw std::invalid_argument("tapes of external functions are not written");
+        finalize();
+        unshare();
+        widen();
+
+        os.write(reinterpret_cast<const char*>(&bandwidth), sizeof(bandwidth));
+        os.write(reinterpret_cast<const char*>(&persistent_adjoints), sizeof(persistent_adjoints));
+        writeStream(os, d);
+        writeStream(os, kinds);
+        writeStream(os, unary);
+        writeStream(os, binary);
+        writeStream(os, nary);
+    }
+
+    /**
+     * Replace this tape by a finalized tape written by write()
+     * @param is binary input stream
+     */
+    void read(std::istream &is) {
+        reset();
+
+        is.read(reinterpret_cast<char*>(&bandwidth), sizeof(bandwidth));
+        is.read(reinterpret_cast<char*>(&persistent_adjoints), sizeof(persistent_adjoints));
+        readStream(is, d);
+        readStream(is, kinds);
+        readStream(is, unary);
+        readStream(is, binary);
+        readStream(is, nary);
+        calls = std::count(kinds.begin(), kinds.end(), (uint8_t)CALL);
+        finalized = true;
     }
 
     /**
@@ -106,7 +1397,8 @@ public:
      * @return memory usage of DCG
      */
     uint64_t getMemorySize() {
-        return sizeof(this)+sizeof(double)*(d.size())+sizeof(id)*v.size()+sizeof(double)*getRam();
+        return sizeof(this)+sizeof(double)*(d.size())+sizeof(I)*v.size()+sizeof(double)*getRam()
+            +kinds.size()+sizeof(int)*(unary.size()+binary.size()+nary.size()+ops.size())+sizeof(double)*constants.size();
     }
 
 
@@ -114,7 +1406,7 @@ public:
 
     // Output as vector
     /*
-    friend std::ostream& operator<<(std::ostream& os, const dag& d) {
+    friend std::ostream& operator<<(std::ostream& os, const basic_dag& d) {
         os << "v (";
         for(auto c : d.v) {
             os << c << ", ";
@@ -134,16 +1426,25 @@ public:
      * Output the as a DCG in the .dot format
      * this is useful for low level debugging
      */
-    friend std::ostream& operator<<(std::ostream& os, const dag& dd) {
+    friend std::ostream& operator<<(std::ostream& os, const basic_dag& dd) {
         os << "digraph G {" << std::endl << "rankdir=LR;" << std::endl;
 
-        auto it = dd.v.rbegin();
-        auto it2 = dd.d.rbegin();
-        while(it != dd.v.rend()) {
-            int id = *it++;
-            int c = *it++;
-            for (int i = 0; i < c; ++i) {
-                os << "\"" << *it++ << "\"->\"" << id << "\" [label=\"" << *it2++ <<  "\"];" << std::endl;
+        if (dd.finalized) {
+            // nodes are named by their adjoint vector offset once the tape is finalized
+            dd.forEach([&](int id, int c, const int* a, const double* p) {
+                for (int i = 0; i < c; ++i) {
+                    os << "\"" << a[i] << "\"->\"" << id << "\" [label=\"" << p[i] <<  "\"];" << std::endl;
+                }
+            });
+        } else {
+            auto it = dd.v.rbegin();
+            auto it2 = dd.d.rbegin();
+            while(it != dd.v.rend()) {
+                int id = *it++;
+                int c = *it++;
+                for (int i = 0; i < c; ++i) {
+                    os << "\"" << *it++ << "\"->\"" << id << "\" [label=\"" << *it2++ <<  "\"];" << std::endl;
+                }
             }
         }
 
@@ -153,5 +1454,9 @@ public:
     }
 };
 
+template<typename I>
+constexpr double basic_dag<I>::units[3];
+
+typedef basic_dag<TAPE_ID> dag;
 
 #endif //PROTO_DAG_HPP
@@ -0,0 +1,143 @@
+#ifndef ADJOINT_DEADTAPE_HPP
+#define ADJOINT_DEADTAPE_HPP
+
+#include <vector>
+#include <cstdint>
+#include <dag.hpp>
+
+/**
+ * Remove the records of every chunk tape that cannot reach the seeded adjoints before it is reversed.
+ * Off by default: the pass runs in the ordered reversal and only pays off for narrow seeds.
+ */
+#ifndef DEAD_TAPE
+#define DEAD_TAPE 0
+#endif
+
+/**
+ * Dead tape elimination.
+ * An adjoint is live if it may be nonzero, at first only the seeded adjoints are live.
+ * Walking the tape in order of reversal a record is live if its result is live, its result is zeroed
+ * and its arguments become live. Dead records would only add zeros and are removed in place.
+ *
+ * The liveness after the reversal of a chunk is the liveness before the reversal of the previous chunk,
+ * aad carries it from chunk to chunk. As it depends on the seed, the pruned tape must not be reversed for other seeds.
+ * @param g the tape to prune
+ * @param live liveness of every adjoint vector position before the reversal of g, updated to the liveness after it
+ */
+inline void eliminateDead(dag &g, std::vector<char> &live) {
+    g.finalize();
+    g.unshare();
+    g.widen();
+    if (live.size() < (uint64_t)g.getRam()) live.resize(g.getRam(), false);
+    if (g.scenarios > 1 || g.calls != 0) {
+        // kept whole, every adjoint may be nonzero behind it
+        std::fill(live.begin(), live.end(), true);
+        return;
+    }
+
+    char* l = live.data();
+    const uint8_t* k = g.kinds.data();
+    const uint8_t* end = k + g.kinds.size();
+    const double* t = g.d.data();
+    const int* u = g.unary.data();
+    const int* b = g.binary.data();
+    const int* n = g.nary.data();
+    // records only move to the front, the write position never passes the read position
+    uint8_t* wk = g.kinds.data();
+    double* wt = g.d.data();
+    int* wu = g.unary.data();
+    int* wb = g.binary.data();
+    int* wn = g.nary.data();
+
+    for (; k != end; ++k) {
+        switch (*k) {
+            case dag::UNARY:
+                if (l[u[0]]) {
+                    l[u[0]] = false;
+                    l[u[1]] = true;
+                    *wk++ = dag::UNARY;
+                    *wt++ = t[0];
+                    wu[0] = u[0];
+                    wu[1] = u[1];
+                    wu += 2;
+                }
+                u += 2;
+                t += 1;
+                break;
+            case dag::BINARY:
+                if (l[b[0]]) {
+                    l[b[0]] = false;
+                    l[b[1]] = true;
+                    l[b[2]] = true;
+                    *wk++ = dag::BINARY;
+                    wt[0] = t[0];
+                    wt[1] = t[1];
+                    wt += 2;
+                    wb[0] = b[0];
+                    wb[1] = b[1];
+                    wb[2] = b[2];
+                    wb += 3;
+                }
+                b += 3;
+                t += 2;
+                break;
+            case dag::UNARY_ADD:
+            case dag::UNARY_SUB:
+                if (l[u[0]]) {
+                    l[u[0]] = false;
+                    l[u[1]] = true;
+                    *wk++ = *k;
+                    wu[0] = u[0];
+                    wu[1] = u[1];
+                    wu += 2;
+                }
+                u += 2;
+                break;
+            case dag::BINARY_ADD:
+            case dag::BINARY_SUB:
+                if (l[b[0]]) {
+                    l[b[0]] = false;
+                    l[b[1]] = true;
+                    l[b[2]] = true;
+                    *wk++ = *k;
+                    wb[0] = b[0];
+                    wb[1] = b[1];
+                    wb[2] = b[2];
+                    wb += 3;
+                }
+                b += 3;
+                break;
+            default: {
+                int c = n[1];
+                if (l[n[0]]) {
+                    l[n[0]] = false;
+                    for (int i = 0; i < c; ++i) {
+                        l[n[2 + i]] = true;
+                    }
+                    *wk++ = dag::NARY;
+                    for (int i = 0; i < c; ++i) {
+                        wt[i] = t[i];
+                    }
+                    wt += c;
+                    for (int i = 0; i < 2 + c; ++i) {
+                        wn[i] = n[i];
+                    }
+                    wn += 2 + c;
+                }
+                n += 2 + c;
+                t += c;
+            }
+        }
+    }
+
+    g.kinds.resize(wk - g.kinds.data());
+    g.d.resize(wt - g.d.data());
+    g.unary.resize(wu - g.unary.data());
+    g.binary.resize(wb - g.binary.data());
+    g.nary.resize(wn - g.nary.data());
+    g.parts.clear();
+    g.partThreads = 0;
+    g.rewritten = true;
+}
+
+#endif //ADJOINT_DEADTAPE_HPP
@@ -0,0 +1,610 @@
+#ifndef ADJOINT_DOUBLE_L_HPP
+#define ADJOINT_DOUBLE_L_HPP
+
+#include <vector>
+#include <cstdint>
+#include <math.h>
+#include <dag.hpp>
+
+template<typename I, int N>
+class basic_double_l;
+
+/**
+ * Base of every expression on lanes of scenarios (expression templates, see expr of double_o.hpp).
+ * A lane expression carries the values of N scenarios, which run the same statements on different inputs,
+ * and the partials of every scenario. Assigned to a double_l it is recorded as a single record, so the tape holds
+ * the index stream once and N partials per edge.
+ *
+ * Every expression E provides
+ * + getValue(j) its value in lane j
+ * + tape() the dag one of its leaves is recorded on (or nullptr)
+ * + propagate(c, adj) hands every leaf with its derivatives times adj (one per lane) to the collector c
+ * + leaves the amount of leaves and lanes the amount of scenarios, known at compile time
+ */
+template<typename E>
+class laneExpr {
+public:
+    const E& self() const {
+        return static_cast<const E&>(*this);
+    }
+
+    double getValue(int j) const {
+        return self().getValue(j);
+    }
+};
+
+/**
+ * Sub-expressions are stored by value, double_l leaves by reference
+ */
+template<typename E>
+struct laneStorage {
+    typedef const E type;
+};
+
+template<typename I, int N>
+struct laneStorage<basic_double_l<I, N>> {
+    typedef const basic_double_l<I, N>& type;
+};
+
+/**
+ * An operation with one overloaded argument, the operators fill in the values and partials of every lane
+ */
+template<typename A>
+class laneUnary : public laneExpr<laneUnary<A>> {
+private:
+    typename laneStorage<A>::type a;
+public:
+    static const int leaves = A::leaves;
+    static const int lanes = A::lanes;
+    double value[lanes];
+    double partial[lanes];
+
+    explicit laneUnary(const A &a): a(a) {}
+
+    double getValue(int j) const {
+        return value[j];
+    }
+
+    auto tape() const -> decltype(a.tape()) {
+        return a.tape();
+    }
+
+    template<typename C>
+    void propagate(C &c, const double* adj) const {
+        double p[lanes];
+        for (int j = 0; j < lanes; ++j) {
+            p[j] = adj[j] * partial[j];
+        }
+        a.propagate(c, p);
+    }
+};
+
+/**
+ * An operation with two overloaded arguments
+ */
+template<typename A, typename B>
+class laneBinary : public laneExpr<laneBinary<A, B>> {
+private:
+    typename laneStorage<A>::type a;
+    typename laneStorage<B>::type b;
+public:
+    static const int leaves = A::leaves + B::leaves;
+    static const int lanes = A::lanes;
+    static_assert(A::lanes == B::lanes, "lane expressions of different amounts of scenarios");
+    double value[lanes];
+    double partialA[lanes];
+    double partialB[lanes];
+
+    laneBinary(const A &a, const B &b): a(a), b(b) {}
+
+    double getValue(int j) const {
+        return value[j];
+    }
+
+    auto tape() const -> decltype(a.tape()) {
+        auto g = a.tape();
+        return g != nullptr ? g : b.tape();
+    }
+
+    template<typename C>
+    void propagate(C &c, const double* adj) const {
+        double p[lanes];
+        for (int j = 0; j < lanes; ++j) {
+            p[j] = adj[j] * partialA[j];
+        }
+        a.propagate(c, p);
+        for (int j = 0; j < lanes; ++j) {
+            p[j] = adj[j] * partialB[j];
+        }
+        b.propagate(c, p);
+    }
+};
+
+/**
+ * Overloaded double carrying N scenarios (value lanes) that share their control flow, e.g. one primal run on
+ * perturbed inputs. Like double_o every assignment records one record, the dag stores its index stream once
+ * and the partials of the N scenarios next to each other (dag::scenarios), the reversal runs over the lanes.
+ *
+ * Branches are taken as in lane 0. A comparison whose outcome differs in another lane marks that lane as
+ * diverged (see diverged()), its tape is no longer the tape of its own scenario. aadScenarios() tapes such
+ * lanes again in a batch of their own.
+ * @tparam I the id type of the dag it is recorded on
+ * @tparam N the amount of scenarios, at most 64
+ */
+template<typename I, int N>
+class basic_double_l : public laneExpr<basic_double_l<I, N>> {
+    static_assert(N >= 1 && N <= 64, "the lanes of a double_l are tracked in a 64 bit mask");
+private:
+    basic_dag<I>* g = nullptr;
+    double value[N];
+    bool isL = false;
+
+    /**
+     * Collects the leaves of an expression, leaves with the same id are merged
+     * @tparam M the maximum amount of leaves
+     */
+    template<int M>
+    struct leafList {
+        const basic_double_l* leaf[M];
+        double partial[M][N];
+        int size = 0;
+
+        void push(const basic_double_l &d, const double* p) {
+            for (int i = 0; i < size; ++i) {
+                if (leaf[i]->id == d.id) {
+                    for (int j = 0; j < N; ++j) {
+                        partial[i][j] += p[j];
+                    }
+                    return;
+                }
+            }
+            leaf[size] = &d;
+            for (int j = 0; j < N; ++j) {
+                partial[size][j] = p[j];
+            }
+            size++;
+        }
+    };
+
+    /**
+     * Evaluate an expression into this double_l, recording a single node for it
+     * @param e the expression
+     * @param persistent if this double_l is a left side (assignment) or a right side (materialized temporary)
+     */
+    template<typename E>
+    void assign(const E &e, bool persistent) {
+        basic_dag<I>* t = e.tape();
+        double v[N];
+        for (int j = 0; j < N; ++j) {
+            v[j] = e.getValue(j);
+        }
+
+        if (t != nullptr) {
+            leafList<E::leaves> l;
+            double ones[N];
+            for (int j = 0; j < N; ++j) {
+                ones[j] = 1;
+            }
+            e.propagate(l, ones);
+
+            if (persistent && id != 0) t->overwrite(id);
+            g = t;
+            for (int i = 0; i < l.size; ++i) {
+                l.leaf[i]->record_arg(l.partial[i]);
+            }
+            isL = persistent;
+            record_res(l.size);
+            for (int i = 0; i < l.size; ++i) {
+                updateBandwidth(*l.leaf[i]);
+            }
+        } else if (persistent && g != nullptr) {
+            // a passive right hand side does not depend on the tape, like the assignment of a passive double_l
+            if (id != 0) {
+                g->overwrite(id);
+                g->unalias(id);
+            }
+            g = nullptr;
+        }
+
+        for (int j = 0; j < N; ++j) {
+            value[j] = v[j];
+        }
+        isL = persistent;
+    }
+public:
+    I id = 0;
+
+    static const int leaves = 1;
+    static const int lanes = N;
+
+    basic_double_l(): basic_double_l(0.0) {}
+
+    /**
+     * The same passive value in every lane
+     */
+    basic_double_l(double c) {
+        for (int j = 0; j < N; ++j) {
+            value[j] = c;
+        }
+    }
+
+    basic_double_l(const basic_double_l &d) {
+        if (d.g != nullptr) g = d.g;
+        for (int j = 0; j < N; ++j) {
+            value[j] = d.value[j];
+        }
+        id = d.id;
+        isL = true;
+    }
+
+    /**
+     * Materialize an expression, the result is recorded like the result of an operation
+     */
+    template<typename E>
+    basic_double_l(const laneExpr<E> &e) {
+        assign(e.self(), false);
+    }
+
+    double getValue(int j) const {
+        return value[j];
+    }
+
+    /**
+     * Set the value of a lane, only valid before the double_l is registered as an input or for passive ones
+     */
+    void setValue(int j, double v) {
+        value[j] = v;
+    }
+
+    basic_dag<I>* tape() const {
+        return g;
+    }
+
+    template<typename C>
+    void propagate(C &c, const double* adj) const {
+        if (g != nullptr) c.push(*this, adj);
+    }
+
+    /**
+     * Lanes whose branches differed from lane 0 since the last reset, bit j stands for lane j.
+     * Kept per thread, every thread tapes its own batch of scenarios.
+     */
+    static uint64_t& diverged() {
+        thread_local uint64_t mask = 0;
+        return mask;
+    }
+
+    /**
+     * Compare all lanes, lanes with another outcome than lane 0 are marked as diverged
+     * @param e the compared expression
+     * @param c the constant it is compared to
+     * @param less if e < c is compared, else e > c
+     * @return the outcome of lane 0
+     */
+    template<typename E>
+    static bool compare(const E &e, double c, bool less) {
+        bool outcome = less ? e.getValue(0) < c : e.getValue(0) > c;
+        for (int j = 1; j < N; ++j) {
+            if ((less ? e.getValue(j) < c : e.getValue(j) > c) != outcome) diverged() |= 1ull << j;
+        }
+        return outcome;
+    }
+
+    void updateBandwidth(const basic_double_l &c) {
+        if (isL || c.isL || g == nullptr) {
+            return;
+        }
+
+        int band = id - c.id;
+        if (band > g->bandwidth) g->bandwidth = band;
+    }
+
+    /**
+     * Register as an input, the dag then records N partials per edge
+     * @param g2 an empty dag or one already recording N scenarios, an empty dag stops recording its operations
+     * (dag::recordOps) like in aadScenarios
+     */
+    void registerInput(basic_dag<I>* g2) {
+        if (g2->scenarios != N) {
+            if (!g2->v.empty() || !g2->ops.empty()) {
+                throw std::invalid_argument("double_l: the dag records another amount of scenarios or its operations");
+            }
+            g2->recordOps = false;
+        }
+        g2->scenarios = N;
+        isL = true;
+        g = g2;
+        id = g->getId(isL);
+
+        g->v.push_back(0);
+        g->v.push_back(id);
+    }
+
+    void record_res(int count) {
+        if (g == nullptr) return;
+        if (!isL || id == 0) {
+            id = g->getId(isL);
+        }
+
+        g->v.push_back(count);
+        g->v.push_back(id);
+        if (isL) g->unalias(id);
+    }
+
+    void record_arg(const double* deriv) const {
+        if (g != nullptr) {
+            g->v.push_back(g->resolve(id));
+            for (int j = 0; j < N; ++j) {
+                g->d.push_back(deriv[j]);
+            }
+        }
+    }
+
+    basic_double_l& operator=(const basic_double_l &d1) {
+        if (&d1 == this) return *this;
+
+        for (int j = 0; j < N; ++j) {
+            value[j] = d1.value[j];
+        }
+        isL = true;
+
+        if (d1.g == nullptr) {
+            // a passive value does not depend on the tape, reads of this double_l are not recorded until the next active assignment
+            if (g != nullptr && id != 0) {
+                g->overwrite(id);
+                g->unalias(id);
+            }
+            g = nullptr;
+            return *this;
+        }
+
+        g = d1.g;
+        if (id == 0) {
+            id = g->getId(true);
+        } else {
+            g->overwrite(id);
+        }
+
+        if (ALIAS_COPIES && id < 0 && d1.id < 0) {
+            g->alias(id, d1.id);
+        } else {
+            double ones[N];
+            for (int j = 0; j < N; ++j) {
+                ones[j] = 1;
+            }
+            d1.record_arg(ones);
+            record_res(1);
+        }
+
+        return *this;
+    }
+
+    /**
+     * Assign a whole right hand side, recorded as a single node
+     */
+    template<typename E>
+    basic_double_l& operator=(const laneExpr<E> &e) {
+        assign(e.self(), true);
+        return *this;
+    }
+
+    /**
+     * Compound assignments, recorded as a single node like their double_o counterparts
+     */
+    template<typename E>
+    basic_double_l& operator+=(const laneExpr<E> &e) {
+        assign(*this + e.self(), true);
+        return *this;
+    }
+    basic_double_l& operator+=(double c) {
+        assign(*this + c, true);
+        return *this;
+    }
+    template<typename E>
+    basic_double_l& operator-=(const laneExpr<E> &e) {
+        assign(*this - e.self(), true);
+        return *this;
+    }
+    basic_double_l& operator-=(double c) {
+        assign(*this - c, true);
+        return *this;
+    }
+    template<typename E>
+    basic_double_l& operator*=(const laneExpr<E> &e) {
+        assign(*this * e.self(), true);
+        return *this;
+    }
+    basic_double_l& operator*=(double c) {
+        assign(*this * c, true);
+        return *this;
+    }
+    template<typename E>
+    basic_double_l& operator/=(const laneExpr<E> &e) {
+        assign(*this / e.self(), true);
+        return *this;
+    }
+    basic_double_l& operator/=(double c) {
+        assign(*this / c, true);
+        return *this;
+    }
+};
+
+template<int N>
+using double_l = basic_double_l<TAPE_ID, N>;
+
+/**
+ * Build a lane operation, f(x, value, partial) computes the value and partial of one lane from the value x of the argument
+ */
+template<typename A, typename F>
+laneUnary<A> laneOp(const A &a, F f) {
+    laneUnary<A> r(a);
+    for (int j = 0; j < laneUnary<A>::lanes; ++j) {
+        f(a.getValue(j), r.value[j], r.partial[j]);
+    }
+    return r;
+}
+
+/**
+ * Build a lane operation, f(x, y, value, partialA, partialB) computes one lane from the values x and y of the arguments
+ */
+template<typename A, typename B, typename F>
+laneBinary<A, B> laneOp(const A &a, const B &b, F f) {
+    laneBinary<A, B> r(a, b);
+    for (int j = 0; j < laneBinary<A, B>::lanes; ++j) {
+        f(a.getValue(j), b.getValue(j), r.value[j], r.partialA[j], r.partialB[j]);
+    }
+    return r;
+}
+
+template<typename A, typename B>
+laneBinary<A, B> operator+(const laneExpr<A> &d1, const laneExpr<B> &d2) {
+    return laneOp(d1.self(), d2.self(), [](double x, double y, double &v, double &p, double &q) { v = x + y; p = 1; q = 1; });
+}
+template<typename A>
+laneUnary<A> operator+(const laneExpr<A> &d1, const double d2) {
+    return laneOp(d1.self(), [d2](double x, double &v, double &p) { v = x + d2; p = 1; });
+}
+template<typename A>
+laneUnary<A> operator+(const double d1, const laneExpr<A> &d2) {
+    return laneOp(d2.self(), [d1](double x, double &v, double &p) { v = d1 + x; p = 1; });
+}
+
+template<typename A, typename B>
+laneBinary<A, B> operator-(const laneExpr<A> &d1, const laneExpr<B> &d2) {
+    return laneOp(d1.self(), d2.self(), [](double x, double y, double &v, double &p, double &q) { v = x - y; p = 1; q = -1; });
+}
+template<typename A>
+laneUnary<A> operator-(const laneExpr<A> &d1, const double d2) {
+    return laneOp(d1.self(), [d2](double x, double &v, double &p) { v = x - d2; p = 1; });
+}
+template<typename A>
+laneUnary<A> operator-(const double d1, const laneExpr<A> &d2) {
+    return laneOp(d2.self(), [d1](double x, double &v, double &p) { v = d1 - x; p = -1; });
+}
+template<typename A>
+laneUnary<A> operator-(const laneExpr<A> &d1) {
+    return laneOp(d1.self(), [](double x, double &v, double &p) { v = -x; p = -1; });
+}
+
+template<typename A, typename B>
+laneBinary<A, B> operator*(const laneExpr<A> &d1, const laneExpr<B> &d2) {
+    return laneOp(d1.self(), d2.self(), [](double x, double y, double &v, double &p, double &q) { v = x * y; p = y; q = x; });
+}
+template<typename A>
+laneUnary<A> operator*(const laneExpr<A> &d1, const double d2) {
+    return laneOp(d1.self(), [d2](double x, double &v, double &p) { v = x * d2; p = d2; });
+}
+template<typename A>
+laneUnary<A> operator*(const double d1, const laneExpr<A> &d2) {
+    return laneOp(d2.self(), [d1](double x, double &v, double &p) { v = d1 * x; p = d1; });
+}
+
+template<typename A, typename B>
+laneBinary<A, B> operator/(const laneExpr<A> &d1, const laneExpr<B> &d2) {
+    return laneOp(d1.self(), d2.self(), [](double x, double y, double &v, double &p, double &q) { v = x / y; p = 1 / y; q = -x / (y * y); });
+}
+template<typename A>
+laneUnary<A> operator/(const laneExpr<A> &d1, const double d2) {
+    return laneOp(d1.self(), [d2](double x, double &v, double &p) { v = x / d2; p = 1 / d2; });
+}
+template<typename A>
+laneUnary<A> operator/(const double d1, const laneExpr<A> &d2) {
+    return laneOp(d2.self(), [d1](double x, double &v, double &p) { v = d1 / x; p = -d1 / (x * x); });
+}
+
+template<typename A>
+laneUnary<A> sin(const laneExpr<A> &d1) {
+    return laneOp(d1.self(), [](double x, double &v, double &p) { v = sin(x); p = cos(x); });
+}
+template<typename A>
+laneUnary<A> cos(const laneExpr<A> &d1) {
+    return laneOp(d1.self(), [](double x, double &v, double &p) { v = cos(x); p = -sin(x); });
+}
+
+template<typename A>
+laneUnary<A> pow(const laneExpr<A> &d1, const int exponent) {
+    return laneOp(d1.self(), [exponent](double x, double &v, double &p) { v = pow(x, exponent); p = exponent * pow(x, exponent - 1); });
+}
+
+/**
+ * Branches follow lane 0, lanes that would branch differently are marked as diverged
+ */
+template<typename A>
+bool operator<(const laneExpr<A> &d1, const double &d2) {
+    return basic_double_l<TAPE_ID, A::lanes>::compare(d1.self(), d2, true);
+}
+template<typename A>
+bool operator>(const laneExpr<A> &d1, const double &d2) {
+    return basic_double_l<TAPE_ID, A::lanes>::compare(d1.self(), d2, false);
+}
+
+/**
+ * Adjoints of a primal for several scenarios at once. The scenarios are taped in batches of N lanes on one tape,
+ * every batch is reversed once over all lanes. Lanes that diverged from lane 0 of their batch are taped again
+ * in a later batch, each batch accepts at least its lane 0.
+ * The whole primal is taped, it is not split into chunks by checkpoints like aad().
+ * @tparam N lanes per batch
+ * @param primal called with the inputs of a batch, overwrites them with its outputs like primal(std::vector<T> &inout)
+ * @param in the inputs of every scenario
+ * @param adjoints the adjoints of the outputs of every scenario, replaced by the adjoints of its inputs
+ * @return the amount of batches taped
+ */
+template<int N, typename F>
+int aadScenarios(F primal, const std::vector<std::vector<double>> &in, std::vector<std::vector<double>> &adjoints) {
+    std::vector<uint64_t> pending;
+    for (uint64_t s = 0; s < in.size(); ++s) {
+        pending.push_back(s);
+    }
+    dag g;
+    std::vector<double> a;
+    int batches = 0;
+
+    while (!pending.empty()) {
+        // unused lanes repeat lane 0, they never diverge
+        uint64_t batch[N];
+        for (int j = 0; j < N; ++j) {
+            batch[j] = pending[(uint64_t)j < pending.size() ? j : 0];
+        }
+        uint64_t n = in[batch[0]].size();
+
+        g.reset();
+        g.recordOps = false;
+        std::vector<double_l<N>> y(n);
+        for (uint64_t i = 0; i < n; ++i) {
+            for (int j = 0; j < N; ++j) {
+                y[i].setValue(j, in[batch[j]][i]);
+            }
+            y[i].registerInput(&g);
+        }
+        double_l<N>::diverged() = 0;
+        primal(y);
+        uint64_t diverged = double_l<N>::diverged();
+        batches++;
+
+        // the inputs and outputs are the first adjoints, as the checkpoint inputs of aad()
+        g.finalize();
+        a.assign((uint64_t)g.getRam() * N, 0);
+        for (uint64_t i = 0; i < n; ++i) {
+            for (int j = 0; j < N; ++j) {
+                a[i * N + j] = adjoints[batch[j]][i];
+            }
+        }
+        g.interpret(a, N);
+
+        std::vector<uint64_t> rest;
+        for (int j = 0; j < N && (uint64_t)j < pending.size(); ++j) {
+            if (diverged >> j & 1) {
+                rest.push_back(batch[j]);
+                continue;
+            }
+            for (uint64_t i = 0; i < n; ++i) {
+                adjoints[batch[j]][i] = a[i * N + j];
+            }
+        }
+        rest.insert(rest.end(), pending.begin() + std::min<uint64_t>(N, pending.size()), pending.end());
+        pending.swap(rest);
+    }
+    return batches;
+}
+
+#endif //ADJOINT_DOUBLE_L_HPP
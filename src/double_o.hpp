@@ -5,282 +5,638 @@
 #include <math.h>
 #include <dag.hpp>
 
+template<typename I>
+class basic_double_o;
+
 /**
- * Data is a datatype that represents a double and all the operations on a double
- * we redefine + - * etc. to generate a dag
+ * Base of every expression on overloaded doubles (expression templates).
+ * Operations on double_o do not record anything, they build an expression that is only recorded
+ * once it is assigned to a double_o. A whole right hand side like d*(y[i-1]-2*y[i]+y[i+1]) thereby becomes
+ * a single record holding the derivatives in direction of the double_o's it was built from (the leaves).
+ *
+ * Every expression E provides
+ * + getValue() its value, computed when the expression is built
+ * + tape() the dag one of its leaves is recorded on (or nullptr)
+ * + propagate(c, adj) hands every leaf with its derivative times adj to the collector c
+ * + leaves the amount of leaves, known at compile time
+ * + emit(p) writes the operations of the expression in postfix to the program p (see basic_dag::opcode)
+ *
+ * Expressions keep references to the double_o's they are built from, so they must not outlive the statement
+ * (do not store them in auto variables).
+ */
+template<typename E>
+class expr {
+public:
+    const E& self() const {
+        return static_cast<const E&>(*this);
+    }
+
+    double getValue() const {
+        return self().getValue();
+    }
+};
+
+/**
+ * Sub-expressions are stored by value, double_o leaves by reference
  */
-class double_o {
+template<typename E>
+struct exprStorage {
+    typedef const E type;
+};
+
+template<typename I>
+struct exprStorage<basic_double_o<I>> {
+    typedef const basic_double_o<I>& type;
+};
+
+/**
+ * Where the constant of a unary operation goes in the operation it was built from
+ */
+enum constantSide { NO_CONSTANT, CONSTANT_RIGHT, CONSTANT_LEFT };
+
+/**
+ * An operation with one overloaded argument, constants are folded into its derivative
+ */
+template<typename A>
+class unaryExpr : public expr<unaryExpr<A>> {
 private:
-    dag* g = nullptr;
-    double value = 0;
-    bool isL = false;
+    typename exprStorage<A>::type a;
+    double value;
+    double partial;
+    int op;
+    double constant;
+    constantSide side;
 public:
-    short id = 0;
+    static const int leaves = A::leaves;
 
-    double_o() = default;
+    /**
+     * @param op the opcode, for OP_POW the constant is the exponent
+     * @param constant the passive operand of a binary operation
+     * @param side where the constant is the operand
+     */
+    unaryExpr(const A &a, double value, double partial, int op, double constant = 0, constantSide side = NO_CONSTANT):
+        a(a), value(value), partial(partial), op(op), constant(constant), side(side) {}
 
-    double_o(double c): value(c) {
-        g = nullptr;
+    double getValue() const {
+        return value;
     }
 
-    double_o(double c, dag* g): value(c) {
-        g = g;
+    auto tape() const -> decltype(a.tape()) {
+        return a.tape();
     }
 
-    double_o(const double_o &d) {
-        if (d.g != nullptr) g = d.g;
-        value = d.value;
-        id = d.id;
-        isL = true;
+    template<typename C>
+    void propagate(C &c, double adj) const {
+        a.propagate(c, adj * partial);
     }
 
-    double getValue() {
-        return value;
+    template<typename P>
+    void emit(P &p) const {
+        if (side == CONSTANT_LEFT) p.constant(constant);
+        a.emit(p);
+        if (side == CONSTANT_RIGHT) p.constant(constant);
+        p.op(op);
+        if (op == OP_POW) p.op((int)constant);
     }
+};
 
-    void updateBandwidth(const double_o &c) {
-        if (isL || c.isL || g == nullptr) {
-            return;
-        }
+/**
+ * An operation with two overloaded arguments
+ */
+template<typename A, typename B>
+class binaryExpr : public expr<binaryExpr<A, B>> {
+private:
+    typename exprStorage<A>::type a;
+    typename exprStorage<B>::type b;
+    double value;
+    double partialA;
+    double partialB;
+    int op;
+public:
+    static const int leaves = A::leaves + B::leaves;
 
-        int band = id - c.id;
-        if (band > g->bandwidth) g->bandwidth = band;
+    binaryExpr(const A &a, const B &b, double value, double partialA, double partialB, int op):
+        a(a), b(b), value(value), partialA(partialA), partialB(partialB), op(op) {}
+
+    double getValue() const {
+        return value;
     }
 
-    void registerInput(dag* g2) {
-        isL = true;
-        g = g2;
-        id = g->getId(isL);
+    auto tape() const -> decltype(a.tape()) {
+        auto g = a.tape();
+        return g != nullptr ? g : b.tape();
+    }
 
-        g->v.push_back(0);
-        g->v.push_back(id);
+    template<typename C>
+    void propagate(C &c, double adj) const {
+        a.propagate(c, adj * partialA);
+        b.propagate(c, adj * partialB);
     }
 
-    void record_res(int count) {
-        if (g == nullptr) return;
-        if (!isL || id == 0) {
-            id = g->getId(isL);
-        }
+    template<typename P>
+    void emit(P &p) const {
+        a.emit(p);
+        b.emit(p);
+        p.op(op);
+    }
+};
 
-        g->v.push_back(count);
-        g->v.push_back(id);
+/**
+ * An operation with three overloaded arguments
+ */
+template<typename A, typename B, typename C>
+class ternaryExpr : public expr<ternaryExpr<A, B, C>> {
+private:
+    typename exprStorage<A>::type a;
+    typename exprStorage<B>::type b;
+    typename exprStorage<C>::type c;
+    double value;
+    double partialA;
+    double partialB;
+    double partialC;
+    int op;
+public:
+    static const int leaves = A::leaves + B::leaves + C::leaves;
+
+    ternaryExpr(const A &a, const B &b, const C &c, double value, double partialA, double partialB, double partialC, int op):
+        a(a), b(b), c(c), value(value), partialA(partialA), partialB(partialB), partialC(partialC), op(op) {}
+
+    double getValue() const {
+        return value;
     }
 
-    void record_arg(double deriv) const {
-        if(g != nullptr) {
-            g->v.push_back(id);
-            g->d.push_back(deriv);
-        }
+    auto tape() const -> decltype(a.tape()) {
+        auto g = a.tape();
+        if (g == nullptr) g = b.tape();
+        return g != nullptr ? g : c.tape();
     }
 
-    friend double_o operator+(const double_o &d1, const double_o &d2) {
-        double_o res;
-        if (d1.g != nullptr && d2.g != nullptr) {
-            res.g = d1.g;
+    template<typename L>
+    void propagate(L &l, double adj) const {
+        a.propagate(l, adj * partialA);
+        b.propagate(l, adj * partialB);
+        c.propagate(l, adj * partialC);
+    }
 
-            d1.record_arg(1);
-            d2.record_arg(1);
+    template<typename P>
+    void emit(P &p) const {
+        a.emit(p);
+        b.emit(p);
+        c.emit(p);
+        p.op(op);
+    }
+};
 
-            res.record_res(2);
-            res.updateBandwidth(d1);
-            res.updateBandwidth(d2);
-        } else if (d1.g != nullptr) {
-            res.g = d1.g;
+/**
+ * Data is a datatype that represents a double and all the operations on a double
+ * we redefine + - * etc. to generate a dag
+ * A double_o does not point to its dag, active double_o's are recorded on the active tape of their thread
+ * (see setTape()), which registerInput() sets. The value, the id and two flags fit into 16 bytes for ids up to int.
+ * Active double_o's must not be used once another tape became the active tape of their thread.
+ * @tparam I the id type of the dag it is recorded on
+ */
+template<typename I>
+class basic_double_o : public expr<basic_double_o<I>> {
+private:
+    double value = 0;
+    bool isL = false;
+    bool active = false;
 
-            d1.record_arg(1);
+    static basic_dag<I>*& current() {
+        static thread_local basic_dag<I>* t = nullptr;
+        return t;
+    }
 
-            res.record_res(1);
-            res.updateBandwidth(d1);
-        } else if (d2.g != nullptr) {
-            res.g = d2.g;
+    /**
+     * Collects the leaves of an expression, leaves with the same id are merged
+     * @tparam N the maximum amount of leaves
+     */
+    template<int N>
+    struct leafList {
+        const basic_double_o* leaf[N];
+        double partial[N];
+        int size = 0;
+
+        void push(const basic_double_o &d, double p) {
+            for (int i = 0; i < size; ++i) {
+                if (leaf[i]->id == d.id) {
+                    partial[i] += p;
+                    return;
+                }
+            }
+            leaf[size] = &d;
+            partial[size++] = p;
+        }
+    };
+
+    /**
+     * Writes the program of an expression to the operation tape. Leaves of a record are referenced
+     * by their position in the leaf list, leaves of a guard by their id.
+     * @tparam L the leaf list of the record, nullptr for a guard
+     */
+    template<typename L>
+    struct program {
+        basic_dag<I>* g;
+        const L* l;
+
+        void leaf(const basic_double_o &d) {
+            if (!d.active) {
+                constant(d.value);
+            } else if (l == nullptr) {
+                g->ops.push_back(OP_LOAD);
+                g->ops.push_back(g->resolve(d.id));
+            } else {
+                int i = 0;
+                while (l->leaf[i]->id != d.id) ++i;
+                g->ops.push_back(OP_LEAF);
+                g->ops.push_back(i);
+            }
+        }
 
-            d2.record_arg(1);
+        void constant(double c) {
+            g->ops.push_back(OP_CONST);
+            g->constants.push_back(c);
+        }
 
-            res.record_res(1);
-            res.updateBandwidth(d2);
+        void op(int o) {
+            g->ops.push_back(o);
+        }
+    };
+
+    /**
+     * Evaluate an expression into this double_o, recording a single node for it
+     * @param e the expression
+     * @param persistent if this double_o is a left side (assignment) or a right side (materialized temporary)
+     */
+    template<typename E>
+    void assign(const E &e, bool persistent) {
+        basic_dag<I>* t = e.tape();
+        double v = e.getValue();
+
+        if (t != nullptr) {
+            leafList<E::leaves> l;
+            e.propagate(l, 1);
+
+            if (persistent && id != 0) t->overwrite(id);
+            // before it is active, this double_o may be a passive leaf of e
+            if (t->recordOps) {
+                program<leafList<E::leaves>> p = {t, &l};
+                t->ops.push_back(OP_EXPR);
+                t->ops.push_back(l.size);
+                e.emit(p);
+                t->ops.push_back(OP_END);
+            }
+            active = true;
+            for (int i = 0; i < l.size; ++i) {
+                l.leaf[i]->record_arg(l.partial[i]);
+            }
+            isL = persistent;
+            record_res(l.size);
+            for (int i = 0; i < l.size; ++i) {
+                updateBandwidth(*l.leaf[i]);
+            }
+        } else if (persistent && active) {
+            // a passive right hand side does not depend on the tape, like the assignment of a passive double_o
+            if (id != 0) {
+                current()->overwrite(id);
+                current()->unalias(id);
+            }
+            active = false;
         }
-        res.value = d1.value + d2.value;
-        return res;
-    }
-    friend double_o operator-(const double_o &d1, const double_o &d2) {
-        double_o res;
-        if (d1.g != nullptr && d2.g != nullptr) {
-            res.g = d1.g;
 
-            d1.record_arg(1);
-            d2.record_arg(-1);
+        value = v;
+        isL = persistent;
+    }
+public:
+    I id = 0;
 
-            res.record_res(2);
-            res.updateBandwidth(d1);
-            res.updateBandwidth(d2);
-        } else if (d1.g != nullptr) {
-            res.g = d1.g;
+    static const int leaves = 1;
 
-            d1.record_arg(1);
+    basic_double_o() = default;
 
-            res.record_res(1);
-            res.updateBandwidth(d1);
-        } else if (d2.g != nullptr) {
-            res.g = d2.g;
+    basic_double_o(double c): value(c) {}
 
-            d2.record_arg(-1);
+    /**
+     * A passive double_o, it is recorded on the active tape once it is assigned an active value
+     */
+    basic_double_o(double c, basic_dag<I>*): value(c) {}
 
-            res.record_res(1);
-            res.updateBandwidth(d2);
-        }
-        res.value = d1.value - d2.value;
-        return res;
+    basic_double_o(const basic_double_o &d) {
+        active = d.active;
+        value = d.value;
+        id = d.id;
+        isL = true;
     }
-    friend double_o operator-(const double_o &d1) {
-        double_o res;
-        if (d1.g != nullptr) {
-            res.g = d1.g;
 
-            d1.record_arg(-1);
-
-            res.record_res(1);
-            res.updateBandwidth(d1);
-        }
-        res.value = -d1.value;
-        return res;
-    }
-    friend double_o operator*(const double_o &d1, const double_o &d2) {
-        double_o res;
-        if (d1.g != nullptr && d2.g != nullptr) {
-            res.g = d1.g;
-            if (d1.id == d2.id) {
-                d1.record_arg(2 * d1.value);
-                res.record_res(1);
-            } else {
-                d1.record_arg(d2.value);
-                d2.record_arg(d1.value);
-                res.record_res(2);
-            }
-        } else if (d1.g != nullptr) {
-            res.g = d1.g;
-
-            d1.record_arg(d2.value);
+    /**
+     * Materialize an expression, the result is recorded like the result of an operation
+     */
+    template<typename E>
+    basic_double_o(const expr<E> &e) {
+        assign(e.self(), false);
+    }
 
-            res.record_res(1);
-            res.updateBandwidth(d1);
-        } else if (d2.g != nullptr) {
-            res.g = d2.g;
+    double getValue() const {
+        return value;
+    }
 
-            d2.record_arg(d1.value);
+    basic_dag<I>* tape() const {
+        return active ? current() : nullptr;
+    }
 
-            res.record_res(1);
-            res.updateBandwidth(d2);
-        }
-        res.value = d1.value * d2.value;
-        return res;
+    /**
+     * Make a dag the active tape of the calling thread, aad sets it for every chunk it tapes (registerInput())
+     * @param t the tape active double_o's are recorded on, nullptr to record nothing
+     */
+    static void setTape(basic_dag<I>* t) {
+        current() = t;
     }
 
-    double_o& operator=(const double_o &d1) {
-        if (&d1 == this) return *this;
+    /**
+     * @return the active tape of the calling thread
+     */
+    static basic_dag<I>* activeTape() {
+        return current();
+    }
 
-        if (d1.g != nullptr) g = d1.g;
+    template<typename C>
+    void propagate(C &c, double adj) const {
+        if (active) c.push(*this, adj);
+    }
 
-        value = d1.value;
+    template<typename P>
+    void emit(P &p) const {
+        p.leaf(*this);
+    }
 
-        isL = true;
+    /**
+     * Record the outcome of a comparison on the operation tape, so a re-evaluation detects a diverging branch
+     * @param e the compared expression
+     * @param t the tape of e
+     * @param c the constant it is compared to
+     * @param outcome if e < c
+     */
+    template<typename E>
+    static void guard(const E &e, basic_dag<I>* t, double c, bool outcome) {
+        if (t == nullptr || !t->recordOps) return;
+        program<leafList<1>> p = {t, nullptr};
+        t->ops.push_back(OP_GUARD);
+        t->ops.push_back(outcome);
+        e.emit(p);
+        p.constant(c);
+        t->ops.push_back(OP_END);
+    }
 
-        if (d1.g != nullptr) {
-            d1.record_arg(1);
-            record_res(1);
+    void updateBandwidth(const basic_double_o &c) {
+        if (isL || c.isL || !active) {
+            return;
         }
 
-        return *this;
+        basic_dag<I>* g = current();
+        int band = id - c.id;
+        if (band > g->bandwidth) g->bandwidth = band;
     }
 
-    friend double_o sin(const double_o &d1) {
-        double_o res;
-        if (d1.g != nullptr) {
-            res.g = d1.g;
+    /**
+     * Register this double_o as an input of a tape, which becomes the active tape of the thread
+     */
+    void registerInput(basic_dag<I>* g) {
+        isL = true;
+        active = true;
+        current() = g;
+        id = g->getId(isL);
 
-            d1.record_arg(cos(d1.value));
+        if (g->recordOps) g->ops.push_back(OP_INPUT);
+        g->v.push_back(0);
+        g->v.push_back(id);
+    }
 
-            res.record_res(1);
-            res.updateBandwidth(d1);
+    void record_res(int count) {
+        if (!active) return;
+        basic_dag<I>* g = current();
+        if (!isL || id == 0) {
+            id = g->getId(isL);
         }
 
-        res.value = sin(d1.value);
-        return res;
+        g->v.push_back(count);
+        g->v.push_back(id);
+        if (isL) g->unalias(id);
     }
-    friend double_o cos(const double_o &d1) {
-        double_o res;
-        if (d1.g != nullptr) {
-            res.g = d1.g;
 
-            d1.record_arg(-sin(d1.value));
-
-            res.record_res(1);
-            res.updateBandwidth(d1);
+    void record_arg(double deriv) const {
+        if (active) {
+            basic_dag<I>* g = current();
+            g->v.push_back(g->resolve(id));
+            g->d.push_back(deriv);
         }
-
-        res.value = cos(d1.value);
-        return res;
     }
-    friend double_o operator/(const double_o &d1, const double_o &d2) {
-        double_o res;
-        if (d1.g != nullptr && d2.g != nullptr) {
-            res.g = d1.g;
 
-            d1.record_arg(1/d2.value);
-            d2.record_arg(-d1.value/(d2.value*d2.value));
-            res.record_res(2);
+    /**
+     * Make this double_o the left side result of an intrinsic (see intrinsics.hpp), which records the result itself.
+     * t->overwrite(id) has to be called before the arguments are recorded.
+     * @param t the tape the intrinsic is recorded on, the active tape
+     * @param v the value computed by the intrinsic
+     * @return the id the result has to be recorded with
+     */
+    I intrinsicResult(basic_dag<I>* t, double v) {
+        active = true;
+        value = v;
+        isL = true;
+        if (id == 0) id = t->getId(true);
+        t->unalias(id);
+        return id;
+    }
 
-        } else if (d1.g != nullptr) {
-            res.g = d1.g;
+    basic_double_o& operator=(const basic_double_o &d1) {
+        if (&d1 == this) return *this;
 
-            d1.record_arg(1/d2.value);
+        value = d1.value;
+        isL = true;
 
-            res.record_res(1);
-            res.updateBandwidth(d1);
-        } else if (d2.g != nullptr) {
-            res.g = d2.g;
+        if (!d1.active) {
+            // a passive value does not depend on the tape, reads of this double_o are not recorded until the next active assignment
+            if (active && id != 0) {
+                current()->overwrite(id);
+                current()->unalias(id);
+            }
+            active = false;
+            return *this;
+        }
 
-            d2.record_arg(-d1.value/(d2.value*d2.value));
+        active = true;
+        basic_dag<I>* g = current();
+        if (id == 0) {
+            id = g->getId(true);
+        } else {
+            g->overwrite(id);
+        }
 
-            res.record_res(1);
-            res.updateBandwidth(d2);
+        if (ALIAS_COPIES && id < 0 && d1.id < 0) {
+            g->alias(id, d1.id);
+        } else {
+            if (g->recordOps) g->ops.push_back(OP_COPY);
+            d1.record_arg(1);
+            record_res(1);
         }
-        res.value = d1.value / d2.value;
-        return res;
-    }
 
-    friend double_o pow(const double_o &d1, const int exponent) {
-        /**
-         * The newly generated output
-         */
-        double_o res;
+        return *this;
+    }
 
-        /**
-         * Test if the provided input is currently being recorded on a dag.
-         */
-        if (d1.g != nullptr) {
-            // the output should also be recorded in that case.
-            res.g = d1.g;
+    /**
+     * Assign a whole right hand side, recorded as a single node
+     */
+    template<typename E>
+    basic_double_o& operator=(const expr<E> &e) {
+        assign(e.self(), true);
+        return *this;
+    }
 
-            // the derivative in direction of d1
-            d1.record_arg(exponent * pow(d1.value, exponent-1));
-            res.record_res(1);
+    /**
+     * Compound assignments, recorded as a single node that updates the persistent id of this double_o in place
+     */
+    template<typename E>
+    basic_double_o& operator+=(const expr<E> &e) {
+        assign(*this + e.self(), true);
+        return *this;
+    }
+    basic_double_o& operator+=(double c) {
+        assign(*this + c, true);
+        return *this;
+    }
 
-        }
-        // real operation
-        res.value = pow(d1.value, exponent);
-        return res;
+    template<typename E>
+    basic_double_o& operator-=(const expr<E> &e) {
+        assign(*this - e.self(), true);
+        return *this;
+    }
+    basic_double_o& operator-=(double c) {
+        assign(*this - c, true);
+        return *this;
     }
 
-    // ADDITIONAL LOGIC / No Overloading, but it is needed to function as a double
-    friend bool operator<(const double_o &d1, const double &d2) {
-        return d1.value < d2;
+    template<typename E>
+    basic_double_o& operator*=(const expr<E> &e) {
+        assign(*this * e.self(), true);
+        return *this;
+    }
+    basic_double_o& operator*=(double c) {
+        assign(*this * c, true);
+        return *this;
     }
 
+    template<typename E>
+    basic_double_o& operator/=(const expr<E> &e) {
+        assign(*this / e.self(), true);
+        return *this;
+    }
+    basic_double_o& operator/=(double c) {
+        assign(*this / c, true);
+        return *this;
+    }
 
-    friend std::ostream& operator<<(std::ostream& os, const double_o& d) {
+    friend std::ostream& operator<<(std::ostream& os, const basic_double_o& d) {
         os << d.value;
         return os;
     }
 };
 
+typedef basic_double_o<TAPE_ID> double_o;
+
+template<typename A, typename B>
+binaryExpr<A, B> operator+(const expr<A> &d1, const expr<B> &d2) {
+    return binaryExpr<A, B>(d1.self(), d2.self(), d1.getValue() + d2.getValue(), 1, 1, OP_ADD);
+}
+template<typename A>
+unaryExpr<A> operator+(const expr<A> &d1, const double d2) {
+    return unaryExpr<A>(d1.self(), d1.getValue() + d2, 1, OP_ADD, d2, CONSTANT_RIGHT);
+}
+template<typename A>
+unaryExpr<A> operator+(const double d1, const expr<A> &d2) {
+    return unaryExpr<A>(d2.self(), d1 + d2.getValue(), 1, OP_ADD, d1, CONSTANT_LEFT);
+}
+
+template<typename A, typename B>
+binaryExpr<A, B> operator-(const expr<A> &d1, const expr<B> &d2) {
+    return binaryExpr<A, B>(d1.self(), d2.self(), d1.getValue() - d2.getValue(), 1, -1, OP_SUB);
+}
+template<typename A>
+unaryExpr<A> operator-(const expr<A> &d1, const double d2) {
+    return unaryExpr<A>(d1.self(), d1.getValue() - d2, 1, OP_SUB, d2, CONSTANT_RIGHT);
+}
+template<typename A>
+unaryExpr<A> operator-(const double d1, const expr<A> &d2) {
+    return unaryExpr<A>(d2.self(), d1 - d2.getValue(), -1, OP_SUB, d1, CONSTANT_LEFT);
+}
+template<typename A>
+unaryExpr<A> operator-(const expr<A> &d1) {
+    return unaryExpr<A>(d1.self(), -d1.getValue(), -1, OP_NEG);
+}
+
+template<typename A, typename B>
+binaryExpr<A, B> operator*(const expr<A> &d1, const expr<B> &d2) {
+    return binaryExpr<A, B>(d1.self(), d2.self(), d1.getValue() * d2.getValue(), d2.getValue(), d1.getValue(), OP_MUL);
+}
+template<typename A>
+unaryExpr<A> operator*(const expr<A> &d1, const double d2) {
+    return unaryExpr<A>(d1.self(), d1.getValue() * d2, d2, OP_MUL, d2, CONSTANT_RIGHT);
+}
+template<typename A>
+unaryExpr<A> operator*(const double d1, const expr<A> &d2) {
+    return unaryExpr<A>(d2.self(), d1 * d2.getValue(), d1, OP_MUL, d1, CONSTANT_LEFT);
+}
+
+template<typename A, typename B>
+binaryExpr<A, B> operator/(const expr<A> &d1, const expr<B> &d2) {
+    double v2 = d2.getValue();
+    return binaryExpr<A, B>(d1.self(), d2.self(), d1.getValue() / v2, 1/v2, -d1.getValue()/(v2*v2), OP_DIV);
+}
+template<typename A>
+unaryExpr<A> operator/(const expr<A> &d1, const double d2) {
+    return unaryExpr<A>(d1.self(), d1.getValue() / d2, 1/d2, OP_DIV, d2, CONSTANT_RIGHT);
+}
+template<typename A>
+unaryExpr<A> operator/(const double d1, const expr<A> &d2) {
+    double v2 = d2.getValue();
+    return unaryExpr<A>(d2.self(), d1 / v2, -d1/(v2*v2), OP_DIV, d1, CONSTANT_LEFT);
+}
+
+template<typename A>
+unaryExpr<A> sin(const expr<A> &d1) {
+    return unaryExpr<A>(d1.self(), sin(d1.getValue()), cos(d1.getValue()), OP_SIN);
+}
+template<typename A>
+unaryExpr<A> cos(const expr<A> &d1) {
+    return unaryExpr<A>(d1.self(), cos(d1.getValue()), -sin(d1.getValue()), OP_COS);
+}
+
+template<typename A>
+unaryExpr<A> pow(const expr<A> &d1, const int exponent) {
+    /**
+     * real operation and the derivative in direction of d1
+     */
+    return unaryExpr<A>(d1.self(), pow(d1.getValue(), exponent), exponent * pow(d1.getValue(), exponent-1), OP_POW, exponent);
+}
+
+/**
+ * Fused multiply add a * b + c rounded once like fma of doubles, passive operands are passive double_o's
+ */
+template<typename A, typename B, typename C>
+ternaryExpr<A, B, C> fma(const expr<A> &a, const expr<B> &b, const expr<C> &c) {
+    return ternaryExpr<A, B, C>(a.self(), b.self(), c.self(), fma(a.getValue(), b.getValue(), c.getValue()),
+                                b.getValue(), a.getValue(), 1, OP_FMA);
+}
+
+template<typename E, typename I>
+void guard(const E &e, basic_dag<I>* t, double c, bool outcome) {
+    basic_double_o<I>::guard(e, t, c, outcome);
+}
+
+// ADDITIONAL LOGIC / No Overloading, but it is needed to function as a double
+template<typename A>
+bool operator<(const expr<A> &d1, const double &d2) {
+    bool outcome = d1.getValue() < d2;
+    guard(d1.self(), d1.self().tape(), d2, outcome);
+    return outcome;
+}
+
 #endif //PROTO_DATA_HPP
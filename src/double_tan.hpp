@@ -0,0 +1,193 @@
+#ifndef ADJOINT_DOUBLE_TAN_HPP
+#define ADJOINT_DOUBLE_TAN_HPP
+
+#include <math.h>
+
+/**
+ * The amount of directions tad() propagates per primal run, the primals are instantiated for double_tan<TAD_DIRECTIONS>
+ */
+#ifndef TAD_DIRECTIONS
+#define TAD_DIRECTIONS 4
+#endif
+
+/**
+ * Overloaded double of the tangent (forward) mode: a value and its derivatives in N directions (tangents).
+ * Every operation updates the tangents right away, nothing is recorded, so a primal run on double_tan's gives
+ * N directional derivatives of every output at the cost of about N + 1 primal runs without any tape.
+ * Few inputs and many outputs are cheaper in tangent mode, where aad() needs one reversal per output.
+ *
+ * The tangent loops run over the directions (omp simd). Branches follow the values like double does.
+ * @tparam N the amount of directions
+ */
+template<int N>
+class double_tan {
+    static_assert(N >= 1, "a double_tan needs at least one direction");
+public:
+    double value;
+    double tangent[N];
+
+    double_tan(double value = 0) : value(value) {
+#pragma omp simd
+        for (int j = 0; j < N; ++j) {
+            tangent[j] = 0;
+        }
+    }
+
+    double getValue() const {
+        return value;
+    }
+
+    double getTangent(int j) const {
+        return tangent[j];
+    }
+
+    void setTangent(int j, double t) {
+        tangent[j] = t;
+    }
+
+    double_tan& operator+=(const double_tan &d) {
+        return *this = *this + d;
+    }
+    double_tan& operator+=(double c) {
+        value += c;
+        return *this;
+    }
+    double_tan& operator-=(const double_tan &d) {
+        return *this = *this - d;
+    }
+    double_tan& operator-=(double c) {
+        value -= c;
+        return *this;
+    }
+    double_tan& operator*=(const double_tan &d) {
+        return *this = *this * d;
+    }
+    double_tan& operator*=(double c) {
+        return *this = *this * c;
+    }
+    double_tan& operator/=(const double_tan &d) {
+        return *this = *this / d;
+    }
+    double_tan& operator/=(double c) {
+        return *this = *this / c;
+    }
+};
+
+/**
+ * The result of an operation with the derivative p in direction of its argument a
+ */
+template<int N>
+double_tan<N> tangentOp(double value, const double_tan<N> &a, double p) {
+    double_tan<N> r;
+    r.value = value;
+#pragma omp simd
+    for (int j = 0; j < N; ++j) {
+        r.tangent[j] = p * a.tangent[j];
+    }
+    return r;
+}
+
+/**
+ * The result of an operation with the derivatives p and q in direction of its arguments a and b
+ */
+template<int N>
+double_tan<N> tangentOp(double value, const double_tan<N> &a, double p, const double_tan<N> &b, double q) {
+    double_tan<N> r;
+    r.value = value;
+#pragma omp simd
+    for (int j = 0; j < N; ++j) {
+        r.tangent[j] = p * a.tangent[j] + q * b.tangent[j];
+    }
+    return r;
+}
+
+template<int N>
+double_tan<N> operator+(const double_tan<N> &d1, const double_tan<N> &d2) {
+    return tangentOp(d1.value + d2.value, d1, 1, d2, 1);
+}
+template<int N>
+double_tan<N> operator+(const double_tan<N> &d1, const double d2) {
+    return tangentOp(d1.value + d2, d1, 1);
+}
+template<int N>
+double_tan<N> operator+(const double d1, const double_tan<N> &d2) {
+    return tangentOp(d1 + d2.value, d2, 1);
+}
+
+template<int N>
+double_tan<N> operator-(const double_tan<N> &d1, const double_tan<N> &d2) {
+    return tangentOp(d1.value - d2.value, d1, 1, d2, -1);
+}
+template<int N>
+double_tan<N> operator-(const double_tan<N> &d1, const double d2) {
+    return tangentOp(d1.value - d2, d1, 1);
+}
+template<int N>
+double_tan<N> operator-(const double d1, const double_tan<N> &d2) {
+    return tangentOp(d1 - d2.value, d2, -1);
+}
+template<int N>
+double_tan<N> operator-(const double_tan<N> &d1) {
+    return tangentOp(-d1.value, d1, -1);
+}
+
+template<int N>
+double_tan<N> operator*(const double_tan<N> &d1, const double_tan<N> &d2) {
+    return tangentOp(d1.value * d2.value, d1, d2.value, d2, d1.value);
+}
+template<int N>
+double_tan<N> operator*(const double_tan<N> &d1, const double d2) {
+    return tangentOp(d1.value * d2, d1, d2);
+}
+template<int N>
+double_tan<N> operator*(const double d1, const double_tan<N> &d2) {
+    return tangentOp(d1 * d2.value, d2, d1);
+}
+
+template<int N>
+double_tan<N> operator/(const double_tan<N> &d1, const double_tan<N> &d2) {
+    return tangentOp(d1.value / d2.value, d1, 1 / d2.value, d2, -d1.value / (d2.value * d2.value));
+}
+template<int N>
+double_tan<N> operator/(const double_tan<N> &d1, const double d2) {
+    return tangentOp(d1.value / d2, d1, 1 / d2);
+}
+template<int N>
+double_tan<N> operator/(const double d1, const double_tan<N> &d2) {
+    return tangentOp(d1 / d2.value, d2, -d1 / (d2.value * d2.value));
+}
+
+template<int N>
+double_tan<N> sin(const double_tan<N> &d1) {
+    return tangentOp(sin(d1.value), d1, cos(d1.value));
+}
+template<int N>
+double_tan<N> cos(const double_tan<N> &d1) {
+    return tangentOp(cos(d1.value), d1, -sin(d1.value));
+}
+
+template<int N>
+double_tan<N> pow(const double_tan<N> &d1, const int exponent) {
+    return tangentOp(pow(d1.value, exponent), d1, exponent * pow(d1.value, exponent - 1));
+}
+
+template<int N>
+double_tan<N> fma(const double_tan<N> &a, const double_tan<N> &b, const double_tan<N> &c) {
+    double_tan<N> r = tangentOp(fma(a.value, b.value, c.value), a, b.value, b, a.value);
+#pragma omp simd
+    for (int j = 0; j < N; ++j) {
+        r.tangent[j] += c.tangent[j];
+    }
+    return r;
+}
+
+template<int N>
+bool operator<(const double_tan<N> &d1, const double &d2) {
+    return d1.value < d2;
+}
+template<int N>
+bool operator>(const double_tan<N> &d1, const double &d2) {
+    return d1.value > d2;
+}
+
+#endif //ADJOINT_DOUBLE_TAN_HPP
@@ -0,0 +1,76 @@
+#ifndef ADJOINT_EXTERNALFUNCTION_HPP
+#define ADJOINT_EXTERNALFUNCTION_HPP
+
+#include <vector>
+#include <stdexcept>
+#include <dag.hpp>
+#include <double_o.hpp>
+#include <intrinsics.hpp>
+
+/**
+ * External functions: a routine on plain doubles (a vendor FFT, a hand optimized sparse solve) called from a primal,
+ * taped as a single CALL_EXTERNAL record instead of its elemental operations. Its adjoint is a callback given by the
+ * primal (dag::externalAdjoint), the reversal hands it the adjoints of the outputs and adds the adjoints of the inputs
+ * it returns to the adjoint vector. With checkpointing the inputs are stored on the tape and handed to the callback,
+ * which can recompute whatever the adjoint needs. Without it the callback has to keep what it needs itself.
+ *
+ * The callback is kept by the tape until the tape is reset, it is called once per lane and has to be safe to call from
+ * the thread reversing the chunk. Passive inputs are handed to the callback, their adjoints are dropped.
+ * Tapes of external functions are neither re-evaluated nor written, a retainedTape keeps their callbacks in memory.
+ */
+
+/**
+ * Call an external function on double_o's
+ * @param primal the routine, called as primal(x, y) on the values, y has the size of the outputs
+ * @param adjoint the adjoint of the routine, see dag::externalAdjoint
+ * @param x the inputs
+ * @param y the outputs, recorded as left sides
+ * @param checkpoint if the inputs are stored on the tape for the adjoint
+ */
+template<typename I, typename F>
+void externalFunction(F primal, typename basic_dag<I>::externalAdjoint adjoint,
+                      const std::vector<basic_double_o<I>> &x, std::vector<basic_double_o<I>> &y, bool checkpoint = true) {
+    std::vector<double> xv(x.size()), yv(y.size());
+    basic_dag<I>* t = nullptr;
+    for (uint64_t i = 0; i < x.size(); ++i) {
+        xv[i] = x[i].getValue();
+        if (x[i].tape() != nullptr) t = x[i].tape();
+    }
+    primal(xv, yv);
+
+    if (t == nullptr || y.empty()) {
+        for (uint64_t i = 0; i < y.size(); ++i) {
+            y[i] = yv[i];
+        }
+        return;
+    }
+    if (t->recordOps) throw std::invalid_argument("external functions are not re-evaluated");
+
+    std::vector<double> data = {(double)t->externals.size()};
+    t->externals.push_back(adjoint);
+    if (checkpoint) data.insert(data.end(), xv.begin(), xv.end());
+
+    std::vector<I> ids;
+    ids.reserve(x.size() + y.size());
+    for (uint64_t i = 0; i < y.size(); ++i) {
+        t->overwrite(y[i].id);
+    }
+    for (uint64_t i = 0; i < x.size(); ++i) {
+        ids.push_back(callArgument(t, x[i]));
+    }
+    for (uint64_t i = 0; i < y.size(); ++i) {
+        ids.push_back(y[i].intrinsicResult(t, yv[i]));
+    }
+    t->recordCall(basic_dag<I>::CALL_EXTERNAL, ids.data(), x.size(), y.size(), data.data(), data.size());
+}
+
+/**
+ * Call an external function on doubles, so templated primals run it passively
+ */
+template<typename F>
+void externalFunction(F primal, const dag::externalAdjoint&, const std::vector<double> &x, std::vector<double> &y,
+                      bool = true) {
+    primal(x, y);
+}
+
+#endif //ADJOINT_EXTERNALFUNCTION_HPP
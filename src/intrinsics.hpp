@@ -0,0 +1,253 @@
+#ifndef ADJOINT_INTRINSICS_HPP
+#define ADJOINT_INTRINSICS_HPP
+
+#include <vector>
+#include <limits>
+#include <dag.hpp>
+#include <double_o.hpp>
+
+/**
+ * Linear algebra intrinsics: dot product, scaled sum, axpy and the tridiagonal solve of gauss.h.
+ * The templates run elementwise on any T, on double_o's they record a single record instead of one per element:
+ * + dot and scaledSum a single n-ary record
+ * + axpy and solveTridiagonal a CALL record (see dag::kind), reversed by the hand written adjoint of dag::reverseCall.
+ *   The adjoint of the solve is the transposed solve with the factors of the primal, a row costs 5 offsets and
+ *   4 doubles on the tape instead of about 5 records.
+ * Passive arguments are left out of the n-ary records and are passive inputs of the calls (dag::passiveId).
+ * The values are the ones of the elementwise templates bit for bit. Intrinsics on tapes that do not record intrinsics
+ * (dag::recordIntrinsics), tapes recording operations (reevaluate() replays elementwise records) or with more arguments
+ * than a record holds are taped elementwise.
+ */
+
+/**
+ * Solve a tridiagonal system as LU(A); FS(A, b); BS(A, b) of gauss.h
+ * @param A row-major serialization of the band, the (sub, diagonal, super) entries of row i at A[3i-1], A[3i], A[3i+1].
+ * The first and the last row are identity rows, their entries are not read. A is scratch space, the elementwise
+ * template overwrites it with its LU factors, a solve recorded as intrinsic keeps it.
+ * @param b the right hand side, replaced by the solution
+ */
+template<typename T>
+void solveTridiagonal(std::vector<T> &A, std::vector<T> &b) {
+    int n = b.size();
+    for (int k = 1; k < n - 1; ++k) {
+        A[2 + k * 3] = A[2 + k * 3] / A[k * 3];
+        A[(k + 1) * 3] = A[(k + 1) * 3] - A[2 + k * 3] * A[(k + 1) * 3 - 2];
+    }
+    for (int i = 1; i < n - 1; ++i) {
+        b[i] = b[i] - A[i * 3 - 1] * b[i - 1];
+    }
+    for (int k = n - 1; k > 1; --k) {
+        b[k - 1] = b[k - 1] - A[(k - 1) * 3 + 1] * b[k];
+        b[k - 1] = b[k - 1] / A[(k - 1) * 3];
+    }
+}
+
+template<typename T>
+T dot(const std::vector<T> &x, const std::vector<T> &y) {
+    T s = 0;
+    for (uint64_t i = 0; i < x.size(); ++i) {
+        s = s + x[i] * y[i];
+    }
+    return s;
+}
+
+/**
+ * @return the sum of the x[i] weighted by the passive w[i]
+ */
+template<typename T>
+T scaledSum(const std::vector<double> &w, const std::vector<T> &x) {
+    T s = 0;
+    for (uint64_t i = 0; i < x.size(); ++i) {
+        s = s + w[i] * x[i];
+    }
+    return s;
+}
+
+/**
+ * y = y + alpha * x
+ */
+template<typename T>
+void axpy(double alpha, const std::vector<T> &x, std::vector<T> &y) {
+    for (uint64_t i = 0; i < y.size(); ++i) {
+        y[i] = y[i] + alpha * x[i];
+    }
+}
+
+/**
+ * The tape intrinsics are recorded on, nullptr if they have to be taped elementwise
+ * @param t a tape of the arguments
+ */
+template<typename I>
+basic_dag<I>* intrinsicTape(basic_dag<I>* t) {
+    return t != nullptr && t->recordIntrinsics && !t->recordOps ? t : nullptr;
+}
+
+/**
+ * The id an intrinsic call reads an argument with
+ * @param t the tape of the call
+ */
+template<typename I>
+I callArgument(basic_dag<I>* t, const basic_double_o<I> &x) {
+    return x.tape() == nullptr ? basic_dag<I>::passiveId : t->resolve(x.id);
+}
+
+/**
+ * Record a sum of active double_o's as a single n-ary record
+ * @param args the summed double_o's
+ * @param partials the derivative in direction of every argument
+ * @param value the value of the sum
+ * @return false if the sum has too many arguments for a record
+ */
+template<typename I>
+bool recordSum(basic_dag<I>* t, basic_double_o<I> &s, const std::vector<const basic_double_o<I>*> &args,
+               const std::vector<double> &partials, double value) {
+    if (args.empty() || args.size() >= (uint64_t)std::numeric_limits<I>::max()) return false;
+    for (uint64_t i = 0; i < args.size(); ++i) {
+        args[i]->record_arg(partials[i]);
+    }
+    t->v.push_back(args.size());
+    t->v.push_back(s.intrinsicResult(t, value));
+    return true;
+}
+
+template<typename I>
+basic_double_o<I> dot(const std::vector<basic_double_o<I>> &x, const std::vector<basic_double_o<I>> &y) {
+    std::vector<const basic_double_o<I>*> args;
+    std::vector<double> partials;
+    basic_dag<I>* t = nullptr;
+    double value = 0;
+    for (uint64_t i = 0; i < x.size(); ++i) {
+        value = value + x[i].getValue() * y[i].getValue();
+        if (x[i].tape() != nullptr) {
+            t = x[i].tape();
+            args.push_back(&x[i]);
+            partials.push_back(y[i].getValue());
+        }
+        if (y[i].tape() != nullptr) {
+            t = y[i].tape();
+            args.push_back(&y[i]);
+            partials.push_back(x[i].getValue());
+        }
+    }
+    basic_double_o<I> s;
+    if (intrinsicTape(t) == nullptr || !recordSum(t, s, args, partials, value)) {
+        // the elementwise template
+        return dot<basic_double_o<I>>(x, y);
+    }
+    return s;
+}
+
+template<typename I>
+basic_double_o<I> scaledSum(const std::vector<double> &w, const std::vector<basic_double_o<I>> &x) {
+    std::vector<const basic_double_o<I>*> args;
+    std::vector<double> partials;
+    basic_dag<I>* t = nullptr;
+    double value = 0;
+    for (uint64_t i = 0; i < x.size(); ++i) {
+        value = value + w[i] * x[i].getValue();
+        if (x[i].tape() != nullptr) {
+            t = x[i].tape();
+            args.push_back(&x[i]);
+            partials.push_back(w[i]);
+        }
+    }
+    basic_double_o<I> s;
+    if (intrinsicTape(t) == nullptr || !recordSum(t, s, args, partials, value)) {
+        return scaledSum<basic_double_o<I>>(w, x);
+    }
+    return s;
+}
+
+/**
+ * Recorded as CALL_AXPY (inputs x then y, outputs y, data alpha)
+ */
+template<typename I>
+void axpy(double alpha, const std::vector<basic_double_o<I>> &x, std::vector<basic_double_o<I>> &y) {
+    int n = y.size();
+    basic_dag<I>* t = nullptr;
+    for (int i = 0; t == nullptr && i < n; ++i) {
+        t = x[i].tape() != nullptr ? x[i].tape() : y[i].tape();
+    }
+    t = intrinsicTape(t);
+    if (t == nullptr) {
+        axpy<basic_double_o<I>>(alpha, x, y);
+        return;
+    }
+
+    std::vector<I> ids(3 * n);
+    for (int i = 0; i < n; ++i) {
+        t->overwrite(y[i].id);
+    }
+    for (int i = 0; i < n; ++i) {
+        ids[i] = callArgument(t, x[i]);
+        ids[n + i] = callArgument(t, y[i]);
+    }
+    for (int i = 0; i < n; ++i) {
+        ids[2 * n + i] = y[i].intrinsicResult(t, y[i].getValue() + alpha * x[i].getValue());
+    }
+    t->recordCall(basic_dag<I>::CALL_AXPY, ids.data(), 2 * n, n, &alpha, 1);
+}
+
+/**
+ * Recorded as CALL_TRIDIAGONAL if there is at least one row to solve.
+ * Inputs: the (sub, diagonal, super) entries of the rows 1..n-2, then b; outputs: b; data: u and l of these rows,
+ * their super diagonal and the solution.
+ */
+template<typename I>
+void solveTridiagonal(std::vector<basic_double_o<I>> &A, std::vector<basic_double_o<I>> &b) {
+    int n = b.size();
+    int m = n - 2;
+    basic_dag<I>* t = nullptr;
+    for (int i = 0; t == nullptr && i < n; ++i) {
+        t = b[i].tape();
+    }
+    for (int i = 2; t == nullptr && i <= 3 * m + 1; ++i) {
+        t = A[i].tape();
+    }
+    t = m >= 1 ? intrinsicTape(t) : nullptr;
+    if (t == nullptr) {
+        solveTridiagonal<basic_double_o<I>>(A, b);
+        return;
+    }
+
+    std::vector<double> a(A.size()), x(n);
+    for (uint64_t i = 0; i < A.size(); ++i) {
+        a[i] = A[i].getValue();
+    }
+    for (int i = 0; i < n; ++i) {
+        x[i] = b[i].getValue();
+    }
+    solveTridiagonal(a, x);
+
+    // a holds the factors, the sub diagonal entry of the first row is not divided (its diagonal is one)
+    std::vector<double> data;
+    data.reserve(3 * m + n);
+    for (int i = 1; i <= m; ++i) {
+        data.push_back(a[3 * i]);
+    }
+    for (int i = 1; i <= m; ++i) {
+        data.push_back(a[3 * i - 1]);
+    }
+    for (int i = 1; i <= m; ++i) {
+        data.push_back(a[3 * i + 1]);
+    }
+    data.insert(data.end(), x.begin(), x.end());
+
+    std::vector<I> ids;
+    ids.reserve(3 * m + 2 * n);
+    for (int i = 0; i < n; ++i) {
+        t->overwrite(b[i].id);
+    }
+    for (int i = 2; i <= 3 * m + 1; ++i) {
+        ids.push_back(callArgument(t, A[i]));
+    }
+    for (int i = 0; i < n; ++i) {
+        ids.push_back(callArgument(t, b[i]));
+    }
+    for (int i = 0; i < n; ++i) {
+        ids.push_back(b[i].intrinsicResult(t, x[i]));
+    }
+    t->recordCall(basic_dag<I>::CALL_TRIDIAGONAL, ids.data(), 3 * m + n, n, data.data(), data.size());
+}
+
+#endif //ADJOINT_INTRINSICS_HPP
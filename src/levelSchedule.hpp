@@ -0,0 +1,142 @@
+#ifndef ADJOINT_LEVELSCHEDULE_HPP
+#define ADJOINT_LEVELSCHEDULE_HPP
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <dag.hpp>
+
+/**
+ * Amount of threads reversing a single chunk tape, 1 reverses every chunk on the thread of the ordered reversal
+ */
+#ifndef REVERSAL_THREADS
+#define REVERSAL_THREADS 1
+#endif
+
+/**
+ * Minimum amount of records of a level to reverse it concurrently, narrower levels are reversed
+ * by one thread as a barrier costs more than they take
+ */
+#ifndef LEVEL_WIDTH
+#define LEVEL_WIDTH 4096
+#endif
+
+/**
+ * Group the records of a reversal tape into dependency levels, so the reversal of one chunk can run on several threads.
+ * Every record is put into the first level after the records it depends on (the last zeroing of its result and of its
+ * arguments, every increment of its result) in which none of its arguments is incremented yet.
+ * The records of a level touch distinct adjoints and can be reversed in any order without atomics.
+ * Increments of one adjoint commute, so they may end up in a different order than on the unscheduled tape.
+ *
+ * The tape is reordered level by level, wide levels are split into one part per thread,
+ * runs of narrow levels form a serial segment.
+ * Runs on a finalized tape, aad calls it on the taping thread so it does not add to the ordered reversal.
+ * @param g the tape to schedule
+ * @param threads amount of threads that reverse the tape
+ * @param width minimum amount of records of a level reversed concurrently
+ */
+inline void levelSchedule(dag &g, int threads, uint64_t width = LEVEL_WIDTH) {
+    g.finalize();
+    g.unshare();
+    g.widen();
+    if (threads <= 1 || g.scenarios > 1 || g.calls != 0) return;
+
+    uint64_t records = g.kinds.size();
+    const size_t maxIncrements = 64;
+
+    /*
+     * Level of every record in order of reversal
+     */
+    std::vector<int> level(records);
+    std::vector<int> lastZero(g.getRam(), -1);
+    std::vector<int> lastIncrement(g.getRam(), -1);
+    std::vector<std::vector<int>> increments(g.getRam());
+    int levels = 0;
+    uint64_t r = 0;
+    g.forEach([&](int x, int c, const int* a, const double*) {
+        int l = std::max(lastZero[x], lastIncrement[x]) + 1;
+        for (int i = 0; i < c; ++i) {
+            l = std::max(l, lastZero[a[i]] + 1);
+            // adjoints incremented by many records are not searched for a free level
+            if (increments[a[i]].size() >= maxIncrements) l = std::max(l, lastIncrement[a[i]] + 1);
+        }
+        for (int i = 0; i < c; ++i) {
+            auto &inc = increments[a[i]];
+            if (std::find(inc.begin(), inc.end(), l) != inc.end()) {
+                ++l;
+                i = -1;
+            }
+        }
+
+        level[r++] = l;
+        levels = std::max(levels, l + 1);
+        lastZero[x] = l;
+        increments[x].clear();
+        for (int i = 0; i < c; ++i) {
+            increments[a[i]].push_back(l);
+            lastIncrement[a[i]] = std::max(lastIncrement[a[i]], l);
+        }
+    });
+    increments = std::vector<std::vector<int>>();
+
+    /*
+     * Start of every level in the reordered streams
+     */
+    std::vector<dag::cursor> start(levels + 1);
+    r = 0;
+    g.forEach([&](int, int c, const int*, const double* p) {
+        dag::measure(start[level[r++] + 1], c, p);
+    });
+    for (int l = 0; l < levels; ++l) {
+        start[l + 1].k += start[l].k;
+        start[l + 1].t += start[l].t;
+        start[l + 1].u += start[l].u;
+        start[l + 1].b += start[l].b;
+        start[l + 1].n += start[l].n;
+    }
+
+    dag out;
+    out.kinds.resize(records);
+    out.d.resize(g.d.size());
+    out.unary.resize(g.unary.size());
+    out.binary.resize(g.binary.size());
+    out.nary.resize(g.nary.size());
+    std::vector<dag::cursor> at(start.begin(), start.end() - 1);
+    r = 0;
+    g.forEach([&](int x, int c, const int* a, const double* p) {
+        out.place(at[level[r++]], x, c, a, p);
+    });
+    level = std::vector<int>();
+
+    /*
+     * Split wide levels into one part per thread, merge narrow ones into serial segments
+     */
+    out.partThreads = threads;
+    bool serial = false;
+    auto closeSerial = [&](const dag::cursor &end) {
+        if (!serial) return;
+        out.parts.insert(out.parts.end(), threads - 1, end);
+        serial = false;
+    };
+    for (int l = 0; l < levels; ++l) {
+        uint64_t count = start[l + 1].k - start[l].k;
+        if (count < width) {
+            if (!serial) out.parts.push_back(start[l]);
+            serial = true;
+            continue;
+        }
+        closeSerial(start[l]);
+        dag::cursor c = start[l];
+        for (int j = 0; j < threads; ++j) {
+            out.parts.push_back(c);
+            uint64_t until = start[l].k + count * (j + 1) / threads;
+            while (c.k < until) out.advance(c);
+        }
+    }
+    closeSerial(start[levels]);
+    out.parts.push_back(start[levels]);
+
+    g.swapReversal(out);
+}
+
+#endif //ADJOINT_LEVELSCHEDULE_HPP
@@ -0,0 +1,74 @@
+#ifndef ADJOINT_MIXEDPRECISION_HPP
+#define ADJOINT_MIXEDPRECISION_HPP
+
+#include <vector>
+#include <cstdint>
+#include <dag.hpp>
+
+/**
+ * Store the partials of every chunk tape as float unless that changes its adjoints by more than MIXED_TOLERANCE
+ */
+#ifndef MIXED_PRECISION
+#define MIXED_PRECISION 0
+#endif
+
+/**
+ * Largest relative error of the adjoints of a chunk with float partials
+ */
+#ifndef MIXED_TOLERANCE
+#define MIXED_TOLERANCE 1e-6
+#endif
+
+/**
+ * Mixed precision tape with an error controlled fallback.
+ * The partials are rounded to float (dag::narrow()), the reversal still accumulates the adjoints in double.
+ * Like the dot product test of verify.hpp the error is estimated on the adjoints that leave the chunk: a random seed on
+ * the registered inputs (every adjoint if there are none) is reversed with double and with float partials.
+ * If the float adjoints are off by more than the tolerance relative to the double ones the tape keeps its doubles.
+ * Costs two reversals and a copy of the partials on the taping thread.
+ * @param g the tape
+ * @param tolerance largest relative error of the adjoints
+ * @return true if the tape stores float partials
+ */
+inline bool narrowPartials(dag &g, double tolerance = MIXED_TOLERANCE) {
+    g.finalize();
+    if (g.narrowed != 0) return true;
+    if (g.d.empty() || g.scenarios > 1 || g.calls != 0) return false;
+
+    std::vector<int> seeded = g.inputs;
+    if (seeded.empty()) {
+        for (int i = 0; i < g.getRam(); ++i) {
+            seeded.push_back(i);
+        }
+    }
+    // xorshift, the estimate is the same for every run
+    uint64_t state = 88172645463325252ull;
+    std::vector<double> exact(g.getRam(), 0);
+    for (int i : seeded) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        exact[i] = (double)(state >> 11) / (double)(1ull << 53) * 2 - 1;
+    }
+    std::vector<double> rounded = exact;
+    g.interpret(exact);
+    // the probe reverses the rounded partials as doubles, the tape keeps its doubles until the error is known
+    tapeVector<double> partials(g.d.size());
+    for (uint64_t i = 0; i < g.d.size(); ++i) {
+        partials[i] = (float)g.d[i];
+    }
+    g.d.swap(partials);
+    g.interpret(rounded);
+    g.d.swap(partials);
+
+    double error = 0, norm = 0;
+    for (int i : seeded) {
+        error += (rounded[i] - exact[i]) * (rounded[i] - exact[i]);
+        norm += exact[i] * exact[i];
+    }
+    if (!(error <= tolerance * tolerance * norm)) return false;
+    g.narrow();
+    return true;
+}
+
+#endif //ADJOINT_MIXEDPRECISION_HPP
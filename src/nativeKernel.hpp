@@ -0,0 +1,295 @@
+#ifndef ADJOINT_NATIVEKERNEL_HPP
+#define ADJOINT_NATIVEKERNEL_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <mutex>
+#include <future>
+#include <algorithm>
+#include <functional>
+#include <dag.hpp>
+#if defined(__linux__)
+#include <dlfcn.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Compile the shared runs of every chunk tape (see sharedStructure.hpp) to native reversal kernels
+ */
+#ifndef NATIVE_KERNELS
+#define NATIVE_KERNELS 0
+#endif
+
+/**
+ * Directory of the generated kernels, including the trailing slash, kernels found there are reused
+ */
+#ifndef NATIVE_KERNEL_DIR
+#define NATIVE_KERNEL_DIR "data/"
+#endif
+
+/**
+ * Compiler command a kernel source is compiled with, followed by the source and the shared object
+ */
+#ifndef NATIVE_KERNEL_CXX
+#define NATIVE_KERNEL_CXX "c++ -O1 -shared -fPIC"
+#endif
+
+/**
+ * Runs with more records are interpreted
+ */
+#ifndef NATIVE_KERNEL_RECORDS
+#define NATIVE_KERNEL_RECORDS 32768
+#endif
+
+/**
+ * Native reversal kernels of shared runs, cached by the hash of their structure.
+ * A kernel reverses every repetition of a run as straight line code, the adjoint offsets are constants,
+ * unit partials are folded into additions and subtractions, only the partials are read from the tape.
+ * Kernels are compiled with the system compiler into a shared object and loaded with dlopen, a kernel
+ * already on disk is loaded without compiling it. Kernels that fail to compile are interpreted.
+ *
+ * The file name holds the generator version and a hash of the compiler command next to the structure hash.
+ * Every kernel exports the structure it was generated for, a kernel is only used for a run of exactly that
+ * structure: stale objects on disk are compiled again, runs colliding with another structure are interpreted.
+ */
+class kernelCache {
+private:
+    /**
+     * Version of the generated code, to be increased with every change of generate()
+     */
+    static const int generatorVersion = 2;
+
+    /**
+     * A loaded kernel and the object it was loaded from
+     */
+    struct entry {
+        void* handle = nullptr;
+        dag::kernel f = nullptr;
+    };
+
+    static std::mutex& lock() {
+        static std::mutex m;
+        return m;
+    }
+
+    /**
+     * Kernels by structure hash, the first thread requesting a structure compiles it outside of the lock
+     */
+    static std::map<uint64_t, std::shared_future<entry>>& kernels() {
+        static std::map<uint64_t, std::shared_future<entry>> k;
+        return k;
+    }
+
+    static std::string& directory() {
+        static std::string d = NATIVE_KERNEL_DIR;
+        return d;
+    }
+
+    /**
+     * Hash of the records of a run, their kinds and offsets
+     */
+    static uint64_t structure(const dag &g, const dag::run &r) {
+        uint64_t h = 14695981039346656037ull ^ r.size.k ^ r.size.t << 32;
+        auto mix = [&h](uint64_t x) {
+            h = (h ^ x) * 1099511628211ull;
+        };
+        for (uint64_t i = 0; i < r.size.k; ++i) mix(g.kinds[r.start.k + i]);
+        for (uint64_t i = 0; i < r.size.u; ++i) mix((uint32_t)g.unary[r.start.u + i]);
+        for (uint64_t i = 0; i < r.size.b; ++i) mix((uint32_t)g.binary[r.start.b + i] | 1ull << 32);
+        for (uint64_t i = 0; i < r.size.n; ++i) mix((uint32_t)g.nary[r.start.n + i] | 2ull << 32);
+        return h;
+    }
+
+    /**
+     * Write the records of a run as the arrays a kernel exports its structure in
+     */
+    static void exportStructure(std::ostream &os, const dag &g, const dag::run &r) {
+        auto array = [&os](const char* type, const char* name, uint64_t size, auto element) {
+            os << "extern \"C\" const " << type << " " << name << "[] = {";
+            for (uint64_t i = 0; i < size; ++i) {
+                os << (i % 32 == 0 ? "\n" : "") << +element(i) << ",";
+            }
+            // an array holds at least one element
+            os << (size == 0 ? "0" : "") << "};\n";
+        };
+        os << "extern \"C\" const unsigned long structure_sizes[] = {" << r.size.k << "," << r.size.u << ","
+           << r.size.b << "," << r.size.n << "," << r.size.t << "};\n";
+        array("unsigned char", "structure_kinds", r.size.k, [&](uint64_t i) { return g.kinds[r.start.k + i]; });
+        array("int", "structure_unary", r.size.u, [&](uint64_t i) { return g.unary[r.start.u + i]; });
+        array("int", "structure_binary", r.size.b, [&](uint64_t i) { return g.binary[r.start.b + i]; });
+        array("int", "structure_nary", r.size.n, [&](uint64_t i) { return g.nary[r.start.n + i]; });
+    }
+
+    /**
+     * If a loaded kernel was generated for the structure of a run
+     */
+    static bool matches(void* handle, const dag &g, const dag::run &r) {
+#if defined(__linux__)
+        auto sizes = reinterpret_cast<const unsigned long*>(dlsym(handle, "structure_sizes"));
+        auto kinds = reinterpret_cast<const uint8_t*>(dlsym(handle, "structure_kinds"));
+        auto unary = reinterpret_cast<const int*>(dlsym(handle, "structure_unary"));
+        auto binary = reinterpret_cast<const int*>(dlsym(handle, "structure_binary"));
+        auto nary = reinterpret_cast<const int*>(dlsym(handle, "structure_nary"));
+        if (sizes == nullptr || kinds == nullptr || unary == nullptr || binary == nullptr || nary == nullptr) return false;
+        if (sizes[0] != r.size.k || sizes[1] != r.size.u || sizes[2] != r.size.b || sizes[3] != r.size.n ||
+            sizes[4] != r.size.t) {
+            return false;
+        }
+        return std::equal(kinds, kinds + r.size.k, g.kinds.data() + r.start.k) &&
+               std::equal(unary, unary + r.size.u, g.unary.data() + r.start.u) &&
+               std::equal(binary, binary + r.size.b, g.binary.data() + r.start.b) &&
+               std::equal(nary, nary + r.size.n, g.nary.data() + r.start.n);
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * Straight line reversal of one repetition per loop iteration, t moves to the partials of the next one.
+     * The records are split into functions of partRecords records, compile times grow faster than their length.
+     */
+    static void generate(std::ostream &os, const dag &g, const dag::run &r) {
+        exportStructure(os, g, r);
+        const uint64_t partRecords = 1024;
+        const uint8_t* k = g.kinds.data() + r.start.k;
+        const int* u = g.unary.data() + r.start.u;
+        const int* b = g.binary.data() + r.start.b;
+        const int* n = g.nary.data() + r.start.n;
+        uint64_t t = 0;
+
+        for (uint64_t i = 0; i < r.size.k; ++i) {
+            if (i % partRecords == 0) {
+                os << (i == 0 ? "" : "}\n") << "static void part" << i / partRecords << "(double* a, const double* t) {\ndouble x;\n";
+            }
+            switch (k[i]) {
+                case dag::UNARY:
+                case dag::UNARY_ADD:
+                case dag::UNARY_SUB:
+                    os << "x = a[" << u[0] << "]; a[" << u[0] << "] = 0; a[" << u[1] << "] ";
+                    if (k[i] == dag::UNARY) os << "+= x*t[" << t++ << "];\n";
+                    else os << (k[i] == dag::UNARY_ADD ? "+= x;\n" : "-= x;\n");
+                    u += 2;
+                    break;
+                case dag::BINARY:
+                    os << "x = a[" << b[0] << "]; a[" << b[0] << "] = 0; a[" << b[1] << "] += x*t[" << t
+                       << "]; a[" << b[2] << "] += x*t[" << t + 1 << "];\n";
+                    t += 2;
+                    b += 3;
+                    break;
+                case dag::BINARY_ADD:
+                case dag::BINARY_SUB:
+                    os << "x = a[" << b[0] << "]; a[" << b[0] << "] = 0; a[" << b[1] << "] += x; a[" << b[2]
+                       << (k[i] == dag::BINARY_ADD ? "] += x;\n" : "] -= x;\n");
+                    b += 3;
+                    break;
+                default:
+                    os << "x = a[" << n[0] << "]; a[" << n[0] << "] = 0;";
+                    for (int j = 0; j < n[1]; ++j) {
+                        os << " a[" << n[2 + j] << "] += x*t[" << t++ << "];";
+                    }
+                    os << "\n";
+                    n += 2 + n[1];
+            }
+        }
+        os << "}\nextern \"C\" void reverse(double* a, const double* t, unsigned long times) {\n"
+           << "for (unsigned long i = 0; i < times; ++i, t += " << r.size.t << ") {\n";
+        for (uint64_t j = 0; j * partRecords < r.size.k; ++j) {
+            os << "part" << j << "(a, t);\n";
+        }
+        os << "}\n}\n";
+    }
+
+    /**
+     * Load the kernel of a run, objects generated for another structure are closed again
+     */
+    static entry load(const std::string &path, const dag &g, const dag::run &r) {
+        entry e;
+#if defined(__linux__)
+        void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (handle == nullptr) return e;
+        auto f = reinterpret_cast<dag::kernel>(dlsym(handle, "reverse"));
+        if (f == nullptr || !matches(handle, g, r)) {
+            dlclose(handle);
+            return e;
+        }
+        // never closed, tapes may hold the kernel until the end of the program
+        e.handle = handle;
+        e.f = f;
+#endif
+        return e;
+    }
+
+    static entry compile(const dag &g, const dag::run &r, uint64_t h) {
+        std::stringstream name;
+        name << directory() << "kernel_v" << generatorVersion << "_" << std::hex
+             << std::hash<std::string>()(NATIVE_KERNEL_CXX) << "_" << h;
+        std::string object = name.str() + ".so";
+        entry e = load(object, g, r);
+        if (e.f != nullptr) return e;
+
+#if defined(__linux__)
+        // written under a temporary name, processes sharing the directory never load a partial kernel
+        std::stringstream temp;
+        temp << name.str() << "." << getpid();
+        std::ofstream source(temp.str() + ".cpp");
+        generate(source, g, r);
+        source.close();
+        if (!source) return e;
+        std::string command = std::string(NATIVE_KERNEL_CXX) + " " + temp.str() + ".cpp -o " + temp.str() + ".so";
+        bool compiled = std::system(command.c_str()) == 0 && std::rename((temp.str() + ".so").c_str(), object.c_str()) == 0;
+        std::remove((temp.str() + ".cpp").c_str());
+        return compiled ? load(object, g, r) : e;
+#else
+        return e;
+#endif
+    }
+public:
+    /**
+     * @param path directory of the generated kernels, including the trailing slash
+     */
+    static void setDirectory(const std::string &path) {
+        directory() = path;
+    }
+
+    /**
+     * The kernel reversing a run, compiled on the first request of its structure
+     * @return nullptr if the kernel is not available, the run has to be interpreted
+     */
+    static dag::kernel get(const dag &g, const dag::run &r) {
+        uint64_t h = structure(g, r);
+        std::promise<entry> compiled;
+        std::shared_future<entry> kernel;
+        bool first = false;
+        {
+            std::lock_guard<std::mutex> lk(lock());
+            auto it = kernels().find(h);
+            first = it == kernels().end();
+            kernel = first ? kernels()[h] = compiled.get_future().share() : it->second;
+        }
+        if (first) compiled.set_value(compile(g, r, h));
+        entry e = kernel.get();
+        // the kernel of a structure colliding with this one in the hash
+        if (e.f != nullptr && !first && !matches(e.handle, g, r)) return nullptr;
+        return e.f;
+    }
+};
+
+/**
+ * Attach native kernels to the repeated runs of a tape sharing structure, tapes without shared runs are left as they are.
+ * Runs of the same structure share one kernel across tapes, only the first one compiles it.
+ * Kernels read double partials, tapes storing float partials are interpreted.
+ * @param g the tape, shareStructure() has to be run before
+ */
+inline void compileRuns(dag &g) {
+    if (g.narrowed != 0) return;
+    for (auto &r : g.runs) {
+        if (r.times >= 2 && r.size.k <= NATIVE_KERNEL_RECORDS) r.native = kernelCache::get(g, r);
+    }
+}
+
+#endif //ADJOINT_NATIVEKERNEL_HPP
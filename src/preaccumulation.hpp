@@ -0,0 +1,119 @@
+#ifndef ADJOINT_PREACCUMULATION_HPP
+#define ADJOINT_PREACCUMULATION_HPP
+
+#include <vector>
+#include <cstdint>
+#include <dag.hpp>
+
+/**
+ * Run the preaccumulation pass on every chunk tape before it is reversed
+ */
+#ifndef PREACCUMULATE
+#define PREACCUMULATE 0
+#endif
+
+/**
+ * Local Jacobian preaccumulation by vertex elimination.
+ * A value that is read exactly once is eliminated: its record is removed and the reading record
+ * takes over its edges, multiplied with the derivative of the read. Edges to the same adjoint are merged.
+ *
+ * A value is only eliminated if none of its arguments is overwritten before it is read, otherwise the
+ * moved edges would reach the overwritten adjoint.
+ * Values of persistent adjoints are only eliminated if they are overwritten later in the same chunk
+ * (like the diffusion / advection helpers of the burgers example), the last value of a persistent adjoint
+ * connects the tape to the previous and next chunk.
+ *
+ * Runs on a finalized tape, aad calls it on the taping thread so it does not add to the ordered reversal.
+ * @param g the tape to shrink
+ */
+inline void preaccumulate(dag &g) {
+    g.finalize();
+    g.unshare();
+    g.widen();
+    if (g.scenarios > 1 || g.calls != 0) return;
+
+    int64_t records = g.kinds.size();
+    int persistent = g.getPersistent();
+
+    /*
+     * Amount of reads of every record's result before it is overwritten, indexed in order of overloading
+     */
+    std::vector<int64_t> writer(g.getRam(), -1);
+    std::vector<uint32_t> reads(records, 0);
+    std::vector<char> overwritten(records, false);
+    std::vector<int> results(records);
+    int64_t f = 0;
+    g.forEachForward([&](int r, int c, const int* a, const double*) {
+        for (int i = 0; i < c; ++i) {
+            int64_t w = writer[a[i]];
+            if (w >= 0) reads[w]++;
+        }
+        if (writer[r] >= 0) overwritten[writer[r]] = true;
+        results[f] = r;
+        writer[r] = f++;
+    });
+
+    /*
+     * Build the preaccumulated edges of every record, absorbing eliminable temporaries
+     */
+    std::fill(writer.begin(), writer.end(), -1);
+    std::vector<int64_t> position(g.getRam(), -1);
+    std::vector<uint64_t> start(records + 1);
+    std::vector<char> alive(records, true);
+    std::vector<int> edges;
+    std::vector<double> derivatives;
+    edges.reserve(g.d.size());
+    derivatives.reserve(g.d.size());
+
+    auto add = [&](int a, double p) {
+        if (position[a] >= 0) {
+            derivatives[position[a]] += p;
+        } else {
+            position[a] = edges.size();
+            edges.push_back(a);
+            derivatives.push_back(p);
+        }
+    };
+
+    auto eliminable = [&](int64_t w, int t) {
+        if ((t < persistent && !overwritten[w]) || reads[w] != 1 || !alive[w]) return false;
+        for (uint64_t e = start[w]; e < start[w + 1]; ++e) {
+            if (edges[e] == t || writer[edges[e]] > w) return false;
+        }
+        return true;
+    };
+
+    f = 0;
+    g.forEachForward([&](int r, int c, const int* a, const double* p) {
+        start[f] = edges.size();
+        for (int i = 0; i < c; ++i) {
+            int64_t w = writer[a[i]];
+            if (w >= 0 && eliminable(w, a[i])) {
+                for (uint64_t e = start[w]; e < start[w + 1]; ++e) {
+                    add(edges[e], p[i] * derivatives[e]);
+                }
+                alive[w] = false;
+            } else {
+                add(a[i], p[i]);
+            }
+        }
+        start[f + 1] = edges.size();
+        for (uint64_t e = start[f]; e < start[f + 1]; ++e) {
+            position[edges[e]] = -1;
+        }
+        writer[r] = f++;
+    });
+
+    /*
+     * Write the remaining records back in order of reversal
+     */
+    dag out;
+    out.d.reserve(edges.size());
+    for (f = records - 1; f >= 0; --f) {
+        if (!alive[f]) continue;
+        out.append(results[f], (int)(start[f + 1] - start[f]), edges.data() + start[f], derivatives.data() + start[f]);
+    }
+    g.swapReversal(out);
+}
+
+#endif //ADJOINT_PREACCUMULATION_HPP
@@ -18,6 +18,7 @@
 
 #include "checkpoint.hpp"
 #include "dag.hpp"
+#include "double_tan.hpp"
 #include "omp.h"
 #include <functional>
 #include <../examples/burgers/burgers.h>
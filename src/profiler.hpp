@@ -84,6 +84,7 @@ void profile(std::vector<double> input, std::vector<double> adjoints) {
     auto start = std::chrono::high_resolution_clock::now();
     dag* a = new dag();
     primal(g, a);
+    a->finalize();
     auto stop = std::chrono::high_resolution_clock::now();
     auto oneChunk = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count();
     std::cout << "CheckpointTapeTime: " << oneChunk << "ms" << std::endl;
@@ -102,6 +103,11 @@ void profile(std::vector<double> input, std::vector<double> adjoints) {
     std::cout << "Used Memory: ~" << memory <<  unit << "(" << ((double)getTotalSystemMemory()/(double)(realSize*cores))*0.9 << "x)" << std::endl;
     std::cout << "Total Tape Size: ~" << (realSize*chunks)/1000/1000/1000 << " GB" << std::endl;
 
+    // Narrowest safe id type, one chunk hands out as many ids as any other
+    int idBytes = a->requiredIdBytes();
+    std::cout << "Tape Id: " << sizeof(TAPE_ID) << "Byte (narrowest safe: "
+              << (idBytes == 2 ? "short" : (idBytes == 4 ? "int" : "int64_t")) << ")" << std::endl;
+
     // Approx. Time to Finish
     adjoints.resize(a->getRam(), 0);
     long long oneChunk2 = 0;
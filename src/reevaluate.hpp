@@ -0,0 +1,285 @@
+#ifndef ADJOINT_REEVALUATE_HPP
+#define ADJOINT_REEVALUATE_HPP
+
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+#include <math.h>
+#include <dag.hpp>
+
+/**
+ * Evaluates the programs of an operation tape, see reevaluate()
+ */
+class opInterpreter {
+private:
+    /**
+     * The operations of the last program in postfix: value, operands (-1 if missing) with the partials in their
+     * direction, the argument a leaf reads (-1 if none)
+     */
+    std::vector<double> value, pa, pb, pc, adj;
+    std::vector<int> a, b, c, leaf, stack, leafNodes;
+    int size = 0;
+    int leafCount = 0;
+
+    void grow() {
+        uint64_t n = 2 * value.size() + 16;
+        value.resize(n);
+        pa.resize(n);
+        pb.resize(n);
+        pc.resize(n);
+        adj.resize(n);
+        a.resize(n);
+        b.resize(n);
+        c.resize(n);
+        leaf.resize(n);
+        stack.resize(n);
+        leafNodes.resize(n);
+    }
+public:
+    /**
+     * Run a program up to its OP_END
+     * @param o the program, moved behind OP_END
+     * @param k the constants, moved behind the ones of the program
+     * @param g the tape, resolves the ids of OP_LOAD
+     * @param leaves values of the arguments of the record
+     * @param values values by adjoint vector position
+     * @return the amount of values left on the stack, they are read with top()
+     */
+    int run(const int* &o, const double* &k, const dag &g, const double* leaves, const double* values) {
+        int top = 0;
+        size = 0;
+        leafCount = 0;
+        for (int op = *o++; op != OP_END; op = *o++) {
+            if ((uint64_t)size == value.size()) grow();
+            int i = size++;
+            leaf[i] = -1;
+            a[i] = -1;
+            b[i] = -1;
+            c[i] = -1;
+            switch (op) {
+                case OP_LEAF:
+                    leaf[i] = *o++;
+                    value[i] = leaves[leaf[i]];
+                    leafNodes[leafCount++] = i;
+                    break;
+                case OP_LOAD:
+                    value[i] = values[g.adjoint_id(*o++)];
+                    break;
+                case OP_CONST:
+                    value[i] = *k++;
+                    break;
+                case OP_NEG:
+                case OP_SIN:
+                case OP_COS:
+                case OP_POW: {
+                    int x = stack[--top];
+                    a[i] = x;
+                    if (op == OP_NEG) {
+                        value[i] = -value[x];
+                        pa[i] = -1;
+                    } else if (op == OP_SIN) {
+                        value[i] = sin(value[x]);
+                        pa[i] = cos(value[x]);
+                    } else if (op == OP_COS) {
+                        value[i] = cos(value[x]);
+                        pa[i] = -sin(value[x]);
+                    } else {
+                        int exponent = *o++;
+                        value[i] = pow(value[x], exponent);
+                        pa[i] = exponent * pow(value[x], exponent-1);
+                    }
+                    break;
+                }
+                case OP_FMA: {
+                    int z = stack[--top];
+                    int y = stack[--top];
+                    int x = stack[--top];
+                    a[i] = x;
+                    b[i] = y;
+                    c[i] = z;
+                    value[i] = fma(value[x], value[y], value[z]);
+                    pa[i] = value[y];
+                    pb[i] = value[x];
+                    pc[i] = 1;
+                    break;
+                }
+                default: {
+                    int y = stack[--top];
+                    int x = stack[--top];
+                    a[i] = x;
+                    b[i] = y;
+                    if (op == OP_ADD) {
+                        value[i] = value[x] + value[y];
+                        pa[i] = 1;
+                        pb[i] = 1;
+                    } else if (op == OP_SUB) {
+                        value[i] = value[x] - value[y];
+                        pa[i] = 1;
+                        pb[i] = -1;
+                    } else if (op == OP_MUL) {
+                        value[i] = value[x] * value[y];
+                        pa[i] = value[y];
+                        pb[i] = value[x];
+                    } else {
+                        value[i] = value[x] / value[y];
+                        pa[i] = 1/value[y];
+                        pb[i] = -value[x]/(value[y]*value[y]);
+                    }
+                }
+            }
+            stack[top++] = i;
+        }
+        return top;
+    }
+
+    /**
+     * @param j position on the stack left by the last program
+     */
+    double top(int j) const {
+        return value[stack[j]];
+    }
+
+    /**
+     * Derivatives of the last program in direction of the arguments of its record. Every operation hands
+     * adj * partial to its operands like the expression templates do, the leaves are summed up in the order the
+     * expression templates visit them, so the partials are bitwise equal to the recorded ones.
+     * @param count amount of arguments, a program reading further leaves does not belong to the record
+     * @param partials filled with count derivatives
+     */
+    void derivatives(int count, double* partials) {
+        adj[size - 1] = 1;
+        for (int i = size - 1; i >= 0; --i) {
+            if (a[i] >= 0) adj[a[i]] = adj[i] * pa[i];
+            if (b[i] >= 0) adj[b[i]] = adj[i] * pb[i];
+            if (c[i] >= 0) adj[c[i]] = adj[i] * pc[i];
+        }
+        // leaves are numbered in the order they are first visited, the first contribution is stored to keep the sign of zeros
+        int seen = 0;
+        for (int j = 0; j < leafCount; ++j) {
+            int i = leafNodes[j];
+            int l = leaf[i];
+            if (l >= count) {
+                throw std::invalid_argument("reevaluate: a program reads more leaves than its record has arguments");
+            }
+            if (l == seen) {
+                partials[seen++] = adj[i];
+            } else {
+                partials[l] += adj[i];
+            }
+        }
+    }
+};
+
+/**
+ * One forward pass of reevaluate()
+ * @param partials nullptr to write the new partials straight to their place in the reversal tape (reversed,
+ * like finalize() stores them), otherwise they are collected in order of recording
+ * @return 0 if a branch diverged, 1 if done, 2 if a record changed its kind and the reversal tape has to be rebuilt
+ */
+inline int replay(dag &g, const std::vector<double> &inputs, std::vector<double> &values, std::vector<double>* partials) {
+    values.assign(g.getRam(), 0);
+
+    opInterpreter interpreter;
+    std::vector<double> leaves, record;
+    uint64_t input = 0;
+    uint64_t pos = 0;
+    const int* o = g.ops.data();
+    const int* end = o + g.ops.size();
+    const double* k = g.constants.data();
+
+    uint64_t kk = g.kinds.size(), t = g.d.size(), bb = g.binary.size();
+    auto place = [&](int c, const double* p) {
+        if (partials != nullptr) {
+            partials->insert(partials->end(), p, p + c);
+            return true;
+        }
+        uint8_t kind = dag::kindOf(c, p);
+        if (kk == 0 || g.kinds[--kk] != kind) return false;
+        if (c == 2) {
+            bb -= 3;
+            // finalize() stores the arguments reversed, a BINARY_SUB the one added to first
+            int first = kind == dag::BINARY_SUB && p[1] == -1;
+            if (g.binary[bb + 1] != g.adjoint_id(g.v[pos + 1 - first])) return false;
+        }
+        if (kind <= dag::NARY) {
+            t -= c;
+            for (int i = 0; i < c; ++i) {
+                g.d[t + c - 1 - i] = p[i];
+            }
+        }
+        return true;
+    };
+
+    while (o != end) {
+        switch (*o++) {
+            case OP_INPUT:
+                if (input == inputs.size()) {
+                    throw std::invalid_argument("reevaluate: the tape registered more inputs than were given");
+                }
+                values[g.adjoint_id(g.v[pos + 1])] = inputs[input++];
+                pos += 2;
+                break;
+            case OP_COPY: {
+                double one = 1;
+                values[g.adjoint_id(g.v[pos + 2])] = values[g.adjoint_id(g.v[pos])];
+                if (!place(1, &one)) return 2;
+                pos += 3;
+                break;
+            }
+            case OP_EXPR: {
+                int c = *o++;
+                leaves.resize(c);
+                record.resize(c);
+                for (int i = 0; i < c; ++i) {
+                    leaves[i] = values[g.adjoint_id(g.v[pos + i])];
+                }
+                int top = interpreter.run(o, k, g, leaves.data(), values.data());
+                interpreter.derivatives(c, record.data());
+                if (!place(c, record.data())) return 2;
+                values[g.adjoint_id(g.v[pos + c + 1])] = interpreter.top(top - 1);
+                pos += c + 2;
+                break;
+            }
+            default: {
+                bool outcome = *o++;
+                interpreter.run(o, k, g, nullptr, values.data());
+                if ((interpreter.top(0) < interpreter.top(1)) != outcome) return 0;
+            }
+        }
+    }
+    return partials != nullptr || (kk == 0 && t == 0) ? 1 : 2;
+}
+
+/**
+ * Re-evaluate a tape that recorded its operations (OPCODE_TAPE or dag::recordOps) on new inputs instead of taping
+ * the primal again. The recording is walked forward, every statement program recomputes the value and the partials
+ * of its record. Unchanged inputs reproduce the recorded partials bitwise.
+ *
+ * The new partials overwrite the old ones in the reversal tape. If a record changes its kind (a partial becomes
+ * +1 / -1 or stops being one) or a pass rewrote the tape, the reversal tape is rebuilt (passes have to be run again).
+ * Branches taken on compared double_o's are guarded, if one of them would go the other way the tape no longer
+ * matches the primal: the re-evaluation stops and the primal has to be taped again.
+ * @param g the tape
+ * @param inputs the new values of the registered inputs in order of registration
+ * @param values filled with the values by adjoint vector position, outputs are read at adjoint_id of their ids
+ * @return false if a branch diverged, the tape is left partially updated
+ */
+inline bool reevaluate(dag &g, const std::vector<double> &inputs, std::vector<double> &values) {
+    if (!g.recordOps) {
+        throw std::invalid_argument("reevaluate: the tape did not record its operations");
+    }
+    g.finalize();
+    g.unshare();
+    g.widen();
+
+    int done = g.rewritten ? 2 : replay(g, inputs, values, nullptr);
+    if (done == 2) {
+        std::vector<double> partials;
+        done = replay(g, inputs, values, &partials);
+        if (done == 1) g.rebuild(partials);
+    }
+    return done == 1;
+}
+
+#endif //ADJOINT_REEVALUATE_HPP
@@ -0,0 +1,218 @@
+#ifndef ADJOINT_RETAINEDTAPE_HPP
+#define ADJOINT_RETAINEDTAPE_HPP
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <dag.hpp>
+#include <tapeCodec.hpp>
+
+/**
+ * Keeps the chunk tapes of an aad run so the adjoints for further seeds can be calculated
+ * by only reversing the tapes again, without generating checkpoints or taping.
+ * Tapes are kept in memory up to a budget, all tapes beyond it are spilled into a file.
+ * With TAPE_COMPRESSION the tapes are kept compressed (see tapeCodec.hpp), the budget applies to the compressed size.
+ * The callbacks of external functions (see externalFunction.hpp) always stay in memory, also for spilled tapes.
+ *
+ * Usage:
+ * retainedTape r;
+ * aad(in, adjoints, time, &r);
+ * r.reverse(otherAdjoints);
+ */
+class retainedTape {
+private:
+#if TAPE_COMPRESSION
+    typedef compressedTape keptTape;
+#else
+    typedef dag keptTape;
+#endif
+
+    /**
+     * Tapes in memory indexed by chunk, nullptr if the chunk was spilled
+     */
+    std::vector<keptTape*> tapes;
+    /**
+     * File offset of every spilled chunk
+     */
+    std::vector<int64_t> offsets;
+    /**
+     * Adjoints of the external functions of every spilled chunk, the file only holds the records
+     */
+    std::vector<std::vector<dag::externalAdjoint>> externals;
+    uint64_t budget;
+    uint64_t used = 0;
+    std::string path;
+    std::fstream file;
+    std::mutex m;
+
+    /**
+     * Make sure chunk i can be stored
+     */
+    void grow(uint64_t i) {
+        if (i >= tapes.size()) {
+            tapes.resize(i + 1, nullptr);
+            offsets.resize(i + 1, -1);
+            externals.resize(i + 1);
+        }
+    }
+
+    void openFile() {
+        if (file.is_open()) return;
+        file.open(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("retainedTape: could not open spill file " + path);
+        }
+    }
+
+    /**
+     * Get the tape of chunk i, spilled tapes are read into the provided buffer
+     */
+    keptTape* get(uint64_t i, keptTape &buffer) {
+        if (tapes[i] != nullptr) return tapes[i];
+        file.seekg(offsets[i]);
+        buffer.read(file);
+        buffer.externals = externals[i];
+        return &buffer;
+    }
+public:
+    /**
+     * @param budget Bytes of tapes to keep in memory, further tapes are spilled
+     * @param directory Directory of the spill file
+     */
+    retainedTape(uint64_t budget = std::numeric_limits<uint64_t>::max(), const std::string &directory = "data/") {
+        this->budget = budget;
+        path = directory + "tape-" + std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count() % 100000000) + "-" +
+                std::to_string(reinterpret_cast<uintptr_t>(this) % 10000) + ".bin";
+    }
+
+    retainedTape(const retainedTape &) = delete;
+    retainedTape& operator=(const retainedTape &) = delete;
+
+    ~retainedTape() {
+        clear();
+    }
+
+    /**
+     * Drop all kept tapes
+     */
+    void clear() {
+        std::lock_guard<std::mutex> lk(m);
+        for (auto g : tapes) {
+            delete g;
+        }
+        tapes.clear();
+        offsets.clear();
+        externals.clear();
+        used = 0;
+        if (file.is_open()) {
+            file.close();
+            std::remove(path.c_str());
+        }
+    }
+
+    /**
+     * Keep the tape of a chunk, can be called concurrently
+     * @param i the chunk
+     * @param tape the finalized tape, retainedTape takes ownership
+     */
+    void keep(uint64_t i, dag* tape) {
+#if TAPE_COMPRESSION
+        keptTape* g = new compressedTape(*tape);
+        delete tape;
+#else
+        keptTape* g = tape;
+        g->shrink();
+#endif
+        uint64_t bytes = g->getMemorySize();
+
+        std::lock_guard<std::mutex> lk(m);
+        grow(i);
+        if (used + bytes <= budget) {
+            used += bytes;
+            tapes[i] = g;
+        } else {
+            openFile();
+            file.seekp(0, std::ios::end);
+            offsets[i] = file.tellp();
+            externals[i] = std::move(g->externals);
+            g->externals.clear();
+            g->write(file);
+            delete g;
+        }
+    }
+
+    /**
+     * The amount of chunks that are kept
+     */
+    uint64_t chunks() const {
+        return tapes.empty() ? 0 : tapes.size() - 1;
+    }
+
+    /**
+     * Memory used by the tapes kept in memory
+     */
+    uint64_t getMemorySize() const {
+        return used;
+    }
+
+    /**
+     * Reverse all kept tapes for a new seed
+     * @param adjoints Adjoint vector, outputs will be placed here. Like aad() it is returned in the size of the seed
+     * resized to the last chunk.
+     */
+    void reverse(std::vector<double> &adjoints) {
+        std::lock_guard<std::mutex> lk(m);
+        keptTape buffer;
+        uint64_t seedSize = 0;
+        for (uint64_t i = chunks(); i >= 1; --i) {
+            keptTape* g = get(i, buffer);
+            if (i == chunks()) {
+                adjoints.resize(g->getRam(), 0);
+                seedSize = adjoints.size();
+            }
+            // chunks with recycled adjoint slots may need more of them than the last chunk
+            if (adjoints.size() < (uint64_t)g->getRam()) adjoints.resize(g->getRam(), 0);
+            g->interpret(adjoints);
+        }
+        adjoints.resize(seedSize);
+    }
+
+    /**
+     * Reverse all kept tapes for several new seeds at once (vector mode)
+     * @param adjoints Vector of Adjoint vectors, outputs will be placed there
+     */
+    void reverse(std::vector<std::vector<double>> &adjoints) {
+        std::lock_guard<std::mutex> lk(m);
+        int lanes = adjoints.size();
+        std::vector<double> interleaved;
+        keptTape buffer;
+        for (uint64_t i = chunks(); i >= 1; --i) {
+            keptTape* g = get(i, buffer);
+            if (i == chunks()) {
+                interleaved.resize((uint64_t)g->getRam()*lanes, 0);
+                for (int j = 0; j < lanes; ++j) {
+                    adjoints[j].resize(g->getRam(), 0);
+                    for (int k = 0; k < g->getRam(); ++k) {
+                        interleaved[(uint64_t)k*lanes + j] = adjoints[j][k];
+                    }
+                }
+            }
+            if (interleaved.size() < (uint64_t)g->getRam()*lanes) interleaved.resize((uint64_t)g->getRam()*lanes, 0);
+            g->interpret(interleaved, lanes);
+        }
+        for (int j = 0; j < lanes; ++j) {
+            for (uint64_t k = 0; k < adjoints[j].size(); ++k) {
+                adjoints[j][k] = interleaved[k*lanes + j];
+            }
+        }
+    }
+};
+
+#endif //ADJOINT_RETAINEDTAPE_HPP
@@ -0,0 +1,171 @@
+#ifndef ADJOINT_SHAREDSTRUCTURE_HPP
+#define ADJOINT_SHAREDSTRUCTURE_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <dag.hpp>
+
+/**
+ * Store the structure of repeated runs of records (time steps, iterations) of every chunk tape once
+ */
+#ifndef SHARE_STRUCTURE
+#define SHARE_STRUCTURE 0
+#endif
+
+/**
+ * Least amount of records a repeated run has to save to be shared
+ */
+#ifndef SHARE_MIN_RECORDS
+#define SHARE_MIN_RECORDS 256
+#endif
+
+/**
+ * Structural sharing of repeated runs of records.
+ * Loops over persistent double_o's record the same records with the same adjoint offsets on every iteration,
+ * only the partials differ. The pass finds runs of records that repeat back to back and keeps the kinds and
+ * offsets of every run once, the partials of all repetitions stay in d (see dag::runs).
+ *
+ * Every record is hashed, the next record with the same hash proposes the length of a run starting at it.
+ * A run is accepted if the following repetitions compare equal stream by stream, else the record is kept as is.
+ * Has to run last, the other passes unshare the tape first.
+ * @param g the finalized tape
+ * @param minRecords least amount of records a run has to save
+ */
+inline void shareStructure(dag &g, uint64_t minRecords = SHARE_MIN_RECORDS) {
+    g.finalize();
+    uint64_t records = g.kinds.size();
+    if (g.partThreads > 1 || g.scenarios > 1 || g.calls != 0 || !g.runs.empty() || records < 2 * minRecords || records >= UINT32_MAX) return;
+
+    const uint32_t none = UINT32_MAX;
+    const uint64_t stride = 64;
+    std::vector<dag::cursor> index(records / stride + 1);
+    std::vector<uint32_t> hash(records), next(records);
+    {
+        dag::cursor c;
+        for (uint64_t i = 0; i < records; ++i) {
+            if (i % stride == 0) index[i / stride] = c;
+            dag::cursor e = c;
+            g.advance(e);
+            uint64_t h = g.kinds[c.k];
+            for (uint64_t j = c.u; j < e.u; ++j) h = h * 0x9E3779B97F4A7C15ull + (uint32_t)g.unary[j];
+            for (uint64_t j = c.b; j < e.b; ++j) h = h * 0x9E3779B97F4A7C15ull + (uint32_t)g.binary[j];
+            for (uint64_t j = c.n; j < e.n; ++j) h = h * 0x9E3779B97F4A7C15ull + (uint32_t)g.nary[j];
+            hash[i] = (uint32_t)(h ^ h >> 32);
+            c = e;
+        }
+
+        // last position of every hash in an open addressing table, walked backwards it yields the next equal record.
+        // Repeating tapes have few distinct hashes, the table grows with them and stays in cache
+        const uint64_t empty = UINT64_MAX;
+        std::vector<uint64_t> table(1 << 12, empty);
+        uint64_t used = 0;
+        auto slot = [&](uint32_t h) {
+            uint64_t mask = table.size() - 1;
+            uint64_t s = (h * 0x9E3779B97F4A7C15ull) >> 32 & mask;
+            while (table[s] != empty && table[s] >> 32 != h) s = (s + 1) & mask;
+            return s;
+        };
+        for (uint64_t i = records; i-- > 0;) {
+            uint64_t s = slot(hash[i]);
+            if (table[s] == empty) {
+                next[i] = none;
+                if (2 * ++used > table.size()) {
+                    std::vector<uint64_t> old(2 * table.size(), empty);
+                    old.swap(table);
+                    for (uint64_t e : old) {
+                        if (e != empty) table[slot((uint32_t)(e >> 32))] = e;
+                    }
+                    s = slot(hash[i]);
+                }
+            } else {
+                next[i] = (uint32_t)table[s];
+            }
+            table[s] = (uint64_t)hash[i] << 32 | i;
+        }
+    }
+
+    auto at = [&](uint64_t i) {
+        dag::cursor c = index[i / stride];
+        while (c.k < i) g.advance(c);
+        return c;
+    };
+    // repetition r of the run [c, c + size) equals the first one
+    auto repeats = [&](const dag::cursor &c, const dag::cursor &size, uint64_t r) {
+        return std::memcmp(g.kinds.data() + c.k, g.kinds.data() + c.k + r * size.k, size.k) == 0
+            && std::memcmp(g.unary.data() + c.u, g.unary.data() + c.u + r * size.u, size.u * sizeof(int)) == 0
+            && std::memcmp(g.binary.data() + c.b, g.binary.data() + c.b + r * size.b, size.b * sizeof(int)) == 0
+            && std::memcmp(g.nary.data() + c.n, g.nary.data() + c.n + r * size.n, size.n * sizeof(int)) == 0;
+    };
+    auto distance = [](const dag::cursor &from, const dag::cursor &to) {
+        dag::cursor s;
+        s.k = to.k - from.k;
+        s.t = to.t - from.t;
+        s.u = to.u - from.u;
+        s.b = to.b - from.b;
+        s.n = to.n - from.n;
+        return s;
+    };
+
+    std::vector<dag::run> runs;
+    dag::cursor c, literal;
+    uint64_t saved = 0;
+    while (c.k < records) {
+        dag::run found = {c, dag::cursor(), 0};
+        uint64_t j = next[c.k];
+        for (int tries = 0; tries < 8 && j != none && 2 * (j - c.k) <= records - c.k; ++tries, j = next[j]) {
+            // count the repetitions on the hashes, only the ones found are compared stream by stream
+            uint64_t length = j - c.k, hashed = 1, times = 1;
+            while (c.k + (hashed + 1) * length <= records
+                   && std::memcmp(&hash[c.k], &hash[c.k + hashed * length], length * sizeof(uint32_t)) == 0) hashed++;
+            if ((hashed - 1) * length < minRecords) continue;
+            dag::cursor size = distance(c, at(j));
+            while (times < hashed && repeats(c, size, times)) times++;
+            if (times >= 2 && (times - 1) * length >= minRecords) {
+                found.size = size;
+                found.times = times;
+                break;
+            }
+        }
+        if (found.times == 0) {
+            g.advance(c);
+            continue;
+        }
+        if (literal.k != c.k) runs.push_back({literal, distance(literal, c), 1});
+        runs.push_back(found);
+        saved += (found.times - 1) * found.size.k;
+        c.k += found.times * found.size.k;
+        c.t += found.times * found.size.t;
+        c.u += found.times * found.size.u;
+        c.b += found.times * found.size.b;
+        c.n += found.times * found.size.n;
+        literal = c;
+    }
+    if (saved == 0) return;
+    if (literal.k != c.k) runs.push_back({literal, distance(literal, c), 1});
+
+    // keep the first repetition of every run, records only move to the front, the partials stay in place
+    g.unshared = c;
+    dag::cursor w;
+    for (auto &r : runs) {
+        std::memmove(g.kinds.data() + w.k, g.kinds.data() + r.start.k, r.size.k);
+        std::memmove(g.unary.data() + w.u, g.unary.data() + r.start.u, r.size.u * sizeof(int));
+        std::memmove(g.binary.data() + w.b, g.binary.data() + r.start.b, r.size.b * sizeof(int));
+        std::memmove(g.nary.data() + w.n, g.nary.data() + r.start.n, r.size.n * sizeof(int));
+        r.start.k = w.k;
+        r.start.u = w.u;
+        r.start.b = w.b;
+        r.start.n = w.n;
+        w.k += r.size.k;
+        w.u += r.size.u;
+        w.b += r.size.b;
+        w.n += r.size.n;
+    }
+    g.kinds.resize(w.k);
+    g.unary.resize(w.u);
+    g.binary.resize(w.b);
+    g.nary.resize(w.n);
+    g.runs.swap(runs);
+}
+
+#endif //ADJOINT_SHAREDSTRUCTURE_HPP
@@ -0,0 +1,99 @@
+#ifndef ADJOINT_SLOTRECYCLING_HPP
+#define ADJOINT_SLOTRECYCLING_HPP
+
+#include <vector>
+#include <algorithm>
+#include <dag.hpp>
+
+/**
+ * Renumber the adjoints of every chunk tape by their lifetime, bounds the adjoint vector by the adjoints live at once
+ */
+#ifndef RECYCLE_SLOTS
+#define RECYCLE_SLOTS 0
+#endif
+
+/**
+ * Adjoint slot recycling, a liveness pass at chunk end.
+ * Every double_o assigned as a left side keeps its own adjoint vector slot for the whole chunk, so the adjoint vector
+ * grows with the distinct double_o's a chunk touches. The adjoint of a value is only live between its last read and
+ * its definition though: walking the tape in order of reversal a slot is taken once a value is read and given back
+ * once the record defining the value zeroed it. Freed slots are reused (last freed first, they are still in cache).
+ *
+ * Only the registered inputs carry adjoints into and out of a chunk (the seeds of aad and the adjoints of the previous
+ * chunk), the front of the adjoint vector up to the last input keeps its offsets. Every other adjoint must not be seeded.
+ * The tape no longer resolves recorded ids, tapes recording operations for reevaluate() are left as they are.
+ * Has to run before the level schedule, records of a level may share recycled slots.
+ * @param g the tape to renumber
+ */
+inline void recycleSlots(dag &g) {
+    g.finalize();
+    if (g.recordOps || g.partThreads > 1 || g.calls != 0) return;
+    g.unshare();
+
+    int pinned = 0;
+    for (int i : g.inputs) {
+        pinned = std::max(pinned, i + 1);
+    }
+    std::vector<int> slot(g.getRam(), -1);
+    for (int i = 0; i < pinned; ++i) {
+        slot[i] = i;
+    }
+    std::vector<int> free;
+    int used = pinned;
+
+    // the slot of the value of adjoint x a record reads
+    auto take = [&](int x) {
+        if (slot[x] < 0) {
+            if (free.empty()) {
+                slot[x] = used++;
+            } else {
+                slot[x] = free.back();
+                free.pop_back();
+            }
+        }
+        return slot[x];
+    };
+    // the slot of the value of adjoint x a record defines, its arguments may already reuse it
+    auto release = [&](int x) {
+        int s = take(x);
+        if (x >= pinned) {
+            slot[x] = -1;
+            free.push_back(s);
+        }
+        return s;
+    };
+
+    int* u = g.unary.data();
+    int* b = g.binary.data();
+    int* n = g.nary.data();
+    for (uint8_t k : g.kinds) {
+        switch (k) {
+            case dag::UNARY:
+            case dag::UNARY_ADD:
+            case dag::UNARY_SUB:
+                u[0] = release(u[0]);
+                u[1] = take(u[1]);
+                u += 2;
+                break;
+            case dag::BINARY:
+            case dag::BINARY_ADD:
+            case dag::BINARY_SUB:
+                b[0] = release(b[0]);
+                b[1] = take(b[1]);
+                b[2] = take(b[2]);
+                b += 3;
+                break;
+            default: {
+                int c = n[1];
+                n[0] = release(n[0]);
+                for (int i = 0; i < c; ++i) {
+                    n[2 + i] = take(n[2 + i]);
+                }
+                n += 2 + c;
+            }
+        }
+    }
+    g.renumbered(pinned, used);
+}
+
+#endif //ADJOINT_SLOTRECYCLING_HPP
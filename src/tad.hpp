@@ -0,0 +1,43 @@
+#ifndef ADJOINT_TAD_HPP
+#define ADJOINT_TAD_HPP
+
+#include <vector>
+#include <primal/primal.hpp>
+#include <double_tan.hpp>
+
+/**
+ * Tangent Algorithmic Differentiation routine, runs the primal on double_tan's, TAD_DIRECTIONS directions per run.
+ * No tape and no checkpoints are needed, every direction gives the exact derivative of all outputs.
+ * @param in Input vector
+ * @param tangents the tangents of the inputs, one vector per direction (autofilled with 0's if too short),
+ * replaced by the tangents of the outputs
+ * @return the outputs of the primal
+ */
+std::vector<double> tad(const std::vector<double> &in, std::vector<std::vector<double>> &tangents) {
+    typedef double_tan<TAD_DIRECTIONS> T;
+    std::vector<double> out = in;
+    for (auto &t : tangents) {
+        t.resize(in.size(), 0);
+    }
+
+    for (uint64_t k = 0; k == 0 || k < tangents.size(); k += TAD_DIRECTIONS) {
+        std::vector<T> inout(in.begin(), in.end());
+        for (uint64_t i = 0; i < in.size(); ++i) {
+            for (uint64_t j = 0; j < TAD_DIRECTIONS && k + j < tangents.size(); ++j) {
+                inout[i].setTangent(j, tangents[k + j][i]);
+            }
+        }
+
+        PRIMAL::primal(inout);
+
+        for (uint64_t i = 0; i < in.size(); ++i) {
+            out[i] = inout[i].getValue();
+            for (uint64_t j = 0; j < TAD_DIRECTIONS && k + j < tangents.size(); ++j) {
+                tangents[k + j][i] = inout[i].getTangent(j);
+            }
+        }
+    }
+    return out;
+}
+
+#endif //ADJOINT_TAD_HPP
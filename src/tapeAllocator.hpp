@@ -0,0 +1,293 @@
+#ifndef ADJOINT_TAPEALLOCATOR_HPP
+#define ADJOINT_TAPEALLOCATOR_HPP
+
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <string>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Back large tape streams with transparent huge pages (Linux only)
+ * Tapes of long chunks span many MB, with 2MB pages the page fault and TLB churn while taping drops.
+ */
+#ifndef TAPE_HUGEPAGES
+#define TAPE_HUGEPAGES 0
+#endif
+
+/**
+ * Bytes of large tape streams every thread keeps in memory, streams allocated beyond it are spilled
+ * into memory mapped scratch files (Linux only). 0 keeps all streams in memory.
+ */
+#ifndef TAPE_MEMORY_BUDGET
+#define TAPE_MEMORY_BUDGET 0
+#endif
+
+/**
+ * Directory of the scratch files of spilled tape streams
+ */
+#ifndef TAPE_SPILL_DIR
+#define TAPE_SPILL_DIR "data/"
+#endif
+
+/**
+ * Out-of-core backing of tape streams.
+ * Lets a chunk tape grow beyond the memory of a node instead of shrinking the chunks (more checkpoints and recompute).
+ * Once the large streams allocated by a thread exceed the budget, further streams are backed by a scratch file
+ * that is mapped into memory. The file is unlinked right away, so it is gone together with its mapping.
+ * The kernel writes the pages out under memory pressure and reads them back on access,
+ * the dag advises the access pattern so the reversal streams are read ahead.
+ */
+class tapeSpill {
+private:
+    struct block {
+        /**
+         * In memory bytes of the allocating thread, nullptr if the block is file backed
+         */
+        std::atomic<uint64_t>* owner;
+        std::size_t bytes;
+    };
+
+    static std::mutex& lock() {
+        static std::mutex m;
+        return m;
+    }
+
+    static std::map<uintptr_t, block>& blocks() {
+        static std::map<uintptr_t, block> b;
+        return b;
+    }
+
+    static std::atomic<uint64_t>& used() {
+        // never freed, the blocks of a thread may be released after it ended
+        thread_local std::atomic<uint64_t>* u = new std::atomic<uint64_t>(0);
+        return *u;
+    }
+
+    static std::atomic<uint64_t>& budget() {
+        // read by every taping thread while setBudget() may change it
+        static std::atomic<uint64_t> b(TAPE_MEMORY_BUDGET);
+        return b;
+    }
+
+    static std::string& directory() {
+        static std::string d = TAPE_SPILL_DIR;
+        return d;
+    }
+
+    static void add(void* p, block b) {
+        std::lock_guard<std::mutex> lk(lock());
+        blocks()[reinterpret_cast<uintptr_t>(p)] = b;
+    }
+public:
+    /**
+     * Access patterns the dag announces for a stream
+     */
+    enum access { SEQUENTIAL, WILLNEED };
+
+    /**
+     * @param bytes per thread memory budget of large tape streams, 0 disables spilling
+     */
+    static void setBudget(uint64_t bytes) {
+        budget() = bytes;
+    }
+
+    static uint64_t getBudget() {
+        return budget();
+    }
+
+    /**
+     * @param path directory of the scratch files, including the trailing slash
+     */
+    static void setDirectory(const std::string &path) {
+        directory() = path;
+    }
+
+    static std::string getDirectory() {
+        return directory();
+    }
+
+    static bool active() {
+#if defined(__linux__)
+        return budget() != 0;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * @return bytes of tape streams that are currently file backed
+     */
+    static uint64_t mapped() {
+        std::lock_guard<std::mutex> lk(lock());
+        uint64_t bytes = 0;
+        for (auto &b : blocks()) {
+            if (b.second.owner == nullptr) bytes += b.second.bytes;
+        }
+        return bytes;
+    }
+
+    /**
+     * Allocate a large stream, in memory while the thread is within its budget, file backed otherwise
+     * @param bytes size of the stream
+     * @param align alignment of in memory streams
+     */
+    static void* allocate(std::size_t bytes, std::size_t align) {
+#if defined(__linux__)
+        std::atomic<uint64_t> &u = used();
+        if (u + bytes <= budget()) {
+            void* p = nullptr;
+            if (posix_memalign(&p, align, (bytes + align - 1) / align * align) != 0) {
+                throw std::bad_alloc();
+            }
+#if TAPE_HUGEPAGES
+            madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+            u += bytes;
+            add(p, {&u, bytes});
+            return p;
+        }
+
+        std::string path = directory() + "tape-XXXXXX";
+        int fd = mkstemp(&path[0]);
+        if (fd < 0) throw std::bad_alloc();
+        unlink(path.c_str());
+        if (ftruncate(fd, bytes) != 0) {
+            close(fd);
+            throw std::bad_alloc();
+        }
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) throw std::bad_alloc();
+        add(p, {nullptr, bytes});
+        return p;
+#else
+        throw std::bad_alloc();
+#endif
+    }
+
+    /**
+     * Release a stream if it was allocated by tapeSpill
+     * @return false if the stream is not known to tapeSpill
+     */
+    static bool deallocate(void* p) {
+#if defined(__linux__)
+        block b;
+        {
+            std::lock_guard<std::mutex> lk(lock());
+            auto it = blocks().find(reinterpret_cast<uintptr_t>(p));
+            if (it == blocks().end()) return false;
+            b = it->second;
+            blocks().erase(it);
+        }
+        if (b.owner != nullptr) {
+            *b.owner -= b.bytes;
+            free(p);
+        } else {
+            munmap(p, b.bytes);
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * Announce how a part of a stream is read, only file backed streams are advised
+     * @param p start of the part
+     * @param bytes length of the part
+     */
+    static void advise(const void* p, std::size_t bytes, access a) {
+#if defined(__linux__)
+        if (!active() || bytes == 0) return;
+        uintptr_t from = reinterpret_cast<uintptr_t>(p);
+        {
+            std::lock_guard<std::mutex> lk(lock());
+            auto it = blocks().upper_bound(from);
+            if (it == blocks().begin()) return;
+            --it;
+            if (it->second.owner != nullptr || from >= it->first + it->second.bytes) return;
+        }
+        uintptr_t page = sysconf(_SC_PAGESIZE);
+        uintptr_t start = from / page * page;
+        madvise(reinterpret_cast<void*>(start), from + bytes - start, a == SEQUENTIAL ? MADV_SEQUENTIAL : MADV_WILLNEED);
+#endif
+    }
+};
+
+/**
+ * Allocator used for all tape streams of the dag.
+ * Small streams are served by the default allocator, streams larger than a huge page
+ * are huge page aligned and advised to be backed by transparent huge pages if TAPE_HUGEPAGES is set.
+ * Large streams are handed to tapeSpill if a memory budget is set.
+ * @tparam T stored type
+ */
+template<typename T>
+class tapeAllocator {
+public:
+    typedef T value_type;
+
+    /**
+     * Size of a transparent huge page on x86-64 / aarch64 Linux
+     */
+    static const std::size_t hugePage = 2 * 1024 * 1024;
+
+    tapeAllocator() = default;
+
+    template<typename U>
+    tapeAllocator(const tapeAllocator<U> &) {}
+
+    T* allocate(std::size_t n) {
+        std::size_t bytes = n * sizeof(T);
+        if (bytes >= hugePage && tapeSpill::active()) {
+            return static_cast<T*>(tapeSpill::allocate(bytes, hugePage));
+        }
+#if TAPE_HUGEPAGES && defined(__linux__)
+        if (bytes >= hugePage) {
+            void* p = nullptr;
+            if (posix_memalign(&p, hugePage, (bytes + hugePage - 1) / hugePage * hugePage) != 0) {
+                throw std::bad_alloc();
+            }
+            madvise(p, bytes, MADV_HUGEPAGE);
+            return static_cast<T*>(p);
+        }
+#endif
+        return static_cast<T*>(::operator new(bytes));
+    }
+
+    void deallocate(T* p, std::size_t n) {
+        if (n * sizeof(T) >= hugePage && tapeSpill::deallocate(p)) {
+            return;
+        }
+#if TAPE_HUGEPAGES && defined(__linux__)
+        if (n * sizeof(T) >= hugePage) {
+            free(p);
+            return;
+        }
+#endif
+        ::operator delete(p);
+    }
+
+    template<typename U>
+    bool operator==(const tapeAllocator<U> &) const { return true; }
+
+    template<typename U>
+    bool operator!=(const tapeAllocator<U> &) const { return false; }
+};
+
+/**
+ * A tape stream
+ */
+template<typename T>
+using tapeVector = std::vector<T, tapeAllocator<T>>;
+
+#endif //ADJOINT_TAPEALLOCATOR_HPP
@@ -0,0 +1,283 @@
+#ifndef ADJOINT_TAPECODEC_HPP
+#define ADJOINT_TAPECODEC_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <dag.hpp>
+
+/**
+ * Compress tapes that are kept by retainedTape
+ */
+#ifndef TAPE_COMPRESSION
+#define TAPE_COMPRESSION 1
+#endif
+
+/**
+ * A finalized tape compressed in blocks of records, for tapes that leave hot memory.
+ * Every block can be decompressed on its own, so a reversal only holds one decompressed block at a time.
+ *
+ * + kinds are packed into 4 bits
+ * + adjoint offsets are stored as the zigzag varint of their difference to the same field of the previous record
+ *   (stencils and time steps repeat the same offset patterns)
+ * + partials are compressed like FPC (Burtscher, Ratanaworabhan): every value is XOR-ed with the better of two
+ *   hash based predictions (last value in the same context / last stride in the same context),
+ *   only the bytes below the leading zero bytes of the residual are stored
+ */
+class compressedTape {
+private:
+    static const int tableBits = 14;
+    static const uint64_t blockRecords = 1 << 16;
+
+    struct block {
+        uint64_t offset;
+        dag::cursor size;
+    };
+
+    std::vector<uint8_t> data;
+    std::vector<block> blocks;
+    int ram = 0;
+
+    static void putVarint(std::vector<uint8_t> &out, uint64_t x) {
+        while (x >= 0x80) {
+            out.push_back((uint8_t)(x | 0x80));
+            x >>= 7;
+        }
+        out.push_back((uint8_t)x);
+    }
+
+    static uint64_t getVarint(const uint8_t* &in) {
+        uint64_t x = 0;
+        int shift = 0;
+        while (*in & 0x80) {
+            x |= (uint64_t)(*in++ & 0x7f) << shift;
+            shift += 7;
+        }
+        return x | (uint64_t)(*in++) << shift;
+    }
+
+    static void putInts(std::vector<uint8_t> &out, const int* s, uint64_t n, int stride) {
+        for (uint64_t i = 0; i < n; ++i) {
+            int64_t delta = (int64_t)s[i] - (i >= (uint64_t)stride ? s[i - stride] : 0);
+            putVarint(out, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+        }
+    }
+
+    static void getInts(const uint8_t* &in, int* s, uint64_t n, int stride) {
+        for (uint64_t i = 0; i < n; ++i) {
+            uint64_t z = getVarint(in);
+            int64_t delta = (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+            s[i] = (int)(delta + (i >= (uint64_t)stride ? s[i - stride] : 0));
+        }
+    }
+
+    /**
+     * The two FPC predictors
+     */
+    struct predictor {
+        std::vector<uint64_t> fcm, dfcm;
+        uint64_t fcmHash = 0, dfcmHash = 0, last = 0;
+
+        predictor(): fcm(1 << tableBits, 0), dfcm(1 << tableBits, 0) {}
+
+        void update(uint64_t bits) {
+            fcm[fcmHash] = bits;
+            fcmHash = ((fcmHash << 6) ^ (bits >> 48)) & ((1 << tableBits) - 1);
+            dfcm[dfcmHash] = bits - last;
+            dfcmHash = ((dfcmHash << 2) ^ ((bits - last) >> 40)) & ((1 << tableBits) - 1);
+            last = bits;
+        }
+    };
+
+    static int leadingZeroBytes(uint64_t x) {
+        if (x == 0) return 8;
+        int z = __builtin_clzll(x) / 8;
+        // 3 bits per count, a count of 4 is stored as 3
+        return z == 4 ? 3 : z;
+    }
+
+    static void putDoubles(std::vector<uint8_t> &out, const double* s, uint64_t n) {
+        predictor p;
+        std::vector<uint8_t> residuals;
+        uint64_t headerStart = out.size();
+        out.resize(out.size() + (n + 1) / 2, 0);
+        for (uint64_t i = 0; i < n; ++i) {
+            uint64_t bits;
+            std::memcpy(&bits, s + i, 8);
+            uint64_t x1 = bits ^ p.fcm[p.fcmHash];
+            uint64_t x2 = bits ^ (p.dfcm[p.dfcmHash] + p.last);
+            p.update(bits);
+
+            int selector = leadingZeroBytes(x2) > leadingZeroBytes(x1);
+            uint64_t x = selector ? x2 : x1;
+            int z = leadingZeroBytes(x);
+            int code = z > 4 ? z - 1 : z;
+            out[headerStart + i / 2] |= (uint8_t)((selector << 3 | code) << (4 * (i & 1)));
+            for (int b = 0; b < 8 - z; ++b) {
+                residuals.push_back((uint8_t)(x >> (8 * b)));
+            }
+        }
+        out.insert(out.end(), residuals.begin(), residuals.end());
+    }
+
+    static void getDoubles(const uint8_t* &in, double* s, uint64_t n) {
+        predictor p;
+        const uint8_t* header = in;
+        const uint8_t* r = in + (n + 1) / 2;
+        for (uint64_t i = 0; i < n; ++i) {
+            int h = (header[i / 2] >> (4 * (i & 1))) & 0xf;
+            int code = h & 7;
+            int z = code >= 4 ? code + 1 : code;
+            uint64_t x = 0;
+            for (int b = 0; b < 8 - z; ++b) {
+                x |= (uint64_t)*r++ << (8 * b);
+            }
+            uint64_t bits = x ^ ((h >> 3) ? p.dfcm[p.dfcmHash] + p.last : p.fcm[p.fcmHash]);
+            p.update(bits);
+            std::memcpy(s + i, &bits, 8);
+        }
+        in = r;
+    }
+
+    /**
+     * Decompress a block into the streams of a tape
+     */
+    void unpack(const block &bl, dag &g) const {
+        g.kinds.resize(bl.size.k);
+        g.d.resize(bl.size.t);
+        g.unary.resize(bl.size.u);
+        g.binary.resize(bl.size.b);
+        g.nary.resize(bl.size.n);
+        g.finalized = true;
+
+        const uint8_t* in = data.data() + bl.offset;
+        for (uint64_t i = 0; i < bl.size.k; ++i) {
+            g.kinds[i] = (in[i / 2] >> (4 * (i & 1))) & 0xf;
+        }
+        in += (bl.size.k + 1) / 2;
+        getInts(in, g.unary.data(), bl.size.u, 2);
+        getInts(in, g.binary.data(), bl.size.b, 3);
+        getInts(in, g.nary.data(), bl.size.n, 1);
+        getDoubles(in, g.d.data(), bl.size.t);
+    }
+public:
+    /**
+     * Adjoints of the external functions of the tape, as dag::externals. They stay in memory, write() does not store them
+     */
+    std::vector<dag::externalAdjoint> externals;
+
+    compressedTape() = default;
+
+    /**
+     * @param g the tape to compress, it is finalized first
+     */
+    explicit compressedTape(dag &g) {
+        g.finalize();
+        g.unshare();
+        g.widen();
+        ram = g.getRam();
+        externals = g.externals;
+        uint64_t records = g.kinds.size();
+
+        dag::cursor from;
+        while (from.k < records) {
+            dag::cursor to = from;
+            while (to.k < records && to.k - from.k < blockRecords) g.advance(to);
+
+            block bl;
+            bl.offset = data.size();
+            bl.size.k = to.k - from.k;
+            bl.size.t = to.t - from.t;
+            bl.size.u = to.u - from.u;
+            bl.size.b = to.b - from.b;
+            bl.size.n = to.n - from.n;
+
+            uint64_t kindStart = data.size();
+            data.resize(data.size() + (bl.size.k + 1) / 2, 0);
+            for (uint64_t i = 0; i < bl.size.k; ++i) {
+                data[kindStart + i / 2] |= (uint8_t)(g.kinds[from.k + i] << (4 * (i & 1)));
+            }
+            putInts(data, g.unary.data() + from.u, bl.size.u, 2);
+            putInts(data, g.binary.data() + from.b, bl.size.b, 3);
+            putInts(data, g.nary.data() + from.n, bl.size.n, 1);
+            putDoubles(data, g.d.data() + from.t, bl.size.t);
+
+            blocks.push_back(bl);
+            from = to;
+        }
+        data.shrink_to_fit();
+    }
+
+    /**
+     * Size of the adjoint vector the tape needs, as dag::getRam()
+     */
+    int getRam() const {
+        return ram;
+    }
+
+    /**
+     * @return memory usage of the compressed tape
+     */
+    uint64_t getMemorySize() const {
+        return sizeof(*this) + data.size() + blocks.size() * sizeof(block);
+    }
+
+    /**
+     * Reverse the tape block by block, as dag::interpret
+     * @param adj Adjoint vector at least the size of getRam()
+     */
+    void interpret(std::vector<double> &adj) const {
+        dag part;
+        part.externals = externals;
+        for (auto &bl : blocks) {
+            unpack(bl, part);
+            part.interpret(adj);
+        }
+    }
+
+    /**
+     * Reverse the tape block by block for several seeds at once, as dag::interpret
+     * @param adj Adjoints laid out as [position][lane]
+     * @param lanes The amount of seeds propagated at once
+     */
+    void interpret(std::vector<double> &adj, int lanes) const {
+        dag part;
+        part.externals = externals;
+        for (auto &bl : blocks) {
+            unpack(bl, part);
+            part.interpret(adj, lanes);
+        }
+    }
+
+    /**
+     * Write the compressed tape in a binary format
+     * @param os binary output stream
+     */
+    void write(std::ostream &os) const {
+        uint64_t n = blocks.size(), bytes = data.size();
+        os.write(reinterpret_cast<const char*>(&ram), sizeof(ram));
+        os.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        os.write(reinterpret_cast<const char*>(blocks.data()), n * sizeof(block));
+        os.write(reinterpret_cast<const char*>(&bytes), sizeof(bytes));
+        os.write(reinterpret_cast<const char*>(data.data()), bytes);
+    }
+
+    /**
+     * Replace this tape by a compressed tape written by write(), without external functions
+     * @param is binary input stream
+     */
+    void read(std::istream &is) {
+        uint64_t n = 0, bytes = 0;
+        externals.clear();
+        is.read(reinterpret_cast<char*>(&ram), sizeof(ram));
+        is.read(reinterpret_cast<char*>(&n), sizeof(n));
+        blocks.resize(n);
+        is.read(reinterpret_cast<char*>(blocks.data()), n * sizeof(block));
+        is.read(reinterpret_cast<char*>(&bytes), sizeof(bytes));
+        data.resize(bytes);
+        is.read(reinterpret_cast<char*>(data.data()), bytes);
+    }
+};
+
+#endif //ADJOINT_TAPECODEC_HPP
@@ -0,0 +1,89 @@
+#ifndef ADJOINT_TAPEPOOL_HPP
+#define ADJOINT_TAPEPOOL_HPP
+
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <dag.hpp>
+
+/**
+ * Keeps one dag per thread and hands it out again for every chunk that thread tapes.
+ * Instead of allocating a new dag per chunk and growing it through reallocations,
+ * a tape is reset between chunks and keeps its memory.
+ * Tapes that are handed out for the first time are pre-sized to the largest chunk seen so far.
+ */
+class tapePool {
+private:
+    std::vector<dag*> tapes;
+    dag::sizes highWater;
+    std::mutex m;
+public:
+    /**
+     * @param concurrent the amount of threads that acquire tapes
+     */
+    tapePool(int concurrent) {
+        tapes = std::vector<dag*>(concurrent, nullptr);
+    }
+
+    tapePool(const tapePool &) = delete;
+    tapePool& operator=(const tapePool &) = delete;
+
+    ~tapePool() {
+        for (auto g : tapes) {
+            delete g;
+        }
+    }
+
+    /**
+     * Get the empty tape of a thread, only ever call this from the thread itself
+     * @param thread the OpenMP thread number
+     * @return an empty tape, pre-sized to the high-water mark of all previous chunks
+     */
+    dag* acquire(int thread) {
+        dag* &g = tapes[thread];
+        if (g == nullptr) {
+            g = new dag();
+        } else {
+            g->reset();
+        }
+
+        dag::sizes s;
+        {
+            std::lock_guard<std::mutex> lk(m);
+            s = highWater;
+        }
+        g->reserve(s);
+        return g;
+    }
+
+    /**
+     * Take a tape out of the pool after its reversal, the caller owns it from now on
+     * and the thread gets a new tape on its next acquire
+     * @param thread the OpenMP thread number
+     * @return the tape of the thread
+     */
+    dag* detach(int thread) {
+        dag* g = tapes[thread];
+        release(g);
+        tapes[thread] = nullptr;
+        return g;
+    }
+
+    /**
+     * Hand a tape back after its reversal, its sizes are folded into the high-water mark
+     * @param g the tape acquired before
+     */
+    void release(dag* g) {
+        dag::sizes s = g->getSizes();
+
+        std::lock_guard<std::mutex> lk(m);
+        highWater.v = std::max(highWater.v, s.v);
+        highWater.d = std::max(highWater.d, s.d);
+        highWater.kinds = std::max(highWater.kinds, s.kinds);
+        highWater.unary = std::max(highWater.unary, s.unary);
+        highWater.binary = std::max(highWater.binary, s.binary);
+        highWater.nary = std::max(highWater.nary, s.nary);
+    }
+};
+
+#endif //ADJOINT_TAPEPOOL_HPP
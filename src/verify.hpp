@@ -6,53 +6,49 @@
 #include <cmath>
 #include <iostream>
 #include "primal/primal.hpp"
+#include <tad.hpp>
+#include <mixedPrecision.hpp>
+#include <algorithm>
 #include <cstdlib>
 #include <ctime>
 
-bool verifyResults(const std::vector<double> &x, const std::vector<double> &yAd, const std::vector<double> &xAd) {
-    std::vector<double> xTan(x.size());
-    double deltaH = 0;
-    for (int i = 0; i < x.size(); i++) {
-        xTan[i] = ((double)(std::rand() % 10000) - 5000) / 1000.;
-        deltaH += x[i];
-    }
-
-    std::vector<double> delta(x.size());
-    for (int i = 0; i < x.size(); i++) {
-        delta[i] = pow(2, -15)*deltaH;
-    }
-
-    std::vector<double> t1(x.size());
-    for (int i = 0; i < x.size(); i++) {
-        t1[i] = x[i] + delta[i]*xTan[i];
-    }
-
-    std::vector<double> t2 = x;
-    PRIMAL::primal(t1);
-    PRIMAL::primal(t2);
+/**
+ * Largest relative error of the dot product test, adjoints of narrowed tapes (MIXED_PRECISION) are off by up to
+ * MIXED_TOLERANCE
+ */
+const double verifyTolerance = MIXED_PRECISION ? MIXED_TOLERANCE : 1e-8;
 
-    std::vector<double> yTan(x.size());
-    for (int i = 0; i < x.size(); i++) {
-        if (delta[i] != 0) {
-            yTan[i] = (t1[i] - t2[i]) / delta[i];
-        } else {
-            yTan[i] = 0;
+/**
+ * Checks the adjoints against the exact tangents of TAD_DIRECTIONS random directions (one tad() run).
+ * For the tangents xTan of the inputs and yTan of the outputs the adjoints fulfill xTan * xAd = yTan * yAd up to rounding.
+ * @return the amount of directions that match
+ */
+int verifyResults(const std::vector<double> &x, const std::vector<double> &yAd, const std::vector<double> &xAd) {
+    std::vector<std::vector<double>> xTan(TAD_DIRECTIONS, std::vector<double>(x.size()));
+    for (auto &t : xTan) {
+        for (uint64_t i = 0; i < x.size(); i++) {
+            t[i] = ((double)(std::rand() % 10000) - 5000) / 1000.;
         }
     }
+    auto yTan = xTan;
+    tad(x, yTan);
 
-    double xT = 0;
-    double yT = 0;
-    for (int i = 0; i < x.size(); ++i) {
-        xT += xTan[i] * xAd[i];
-        yT += yTan[i] * yAd[i];
+    int right = 0;
+    for (int j = 0; j < TAD_DIRECTIONS; ++j) {
+        double xT = 0;
+        double yT = 0;
+        for (uint64_t i = 0; i < x.size(); ++i) {
+            xT += xTan[j][i] * (i < xAd.size() ? xAd[i] : 0);
+            yT += yTan[j][i] * (i < yAd.size() ? yAd[i] : 0);
+        }
+        if (std::abs(xT - yT) <= verifyTolerance * std::max(1., std::abs(yT))) right++;
     }
-
-    return (abs(xT - yT) < 0.1);
+    return right;
 }
 
 /**
  * A basic Unit-Test to determine if the provided results match the current primal function
- * We calculate the TAD (Tanget Algorithmic Diffrentiation) using a finite difference approximation.
+ * We calculate the TAD (Tangent Algorithmic Differentiation) of random directions with double_tan's.
  * We then use these randomly generated tangents to verify the given Adjoints that where provided.
  * @param x original input
  * @param yAd the provided adjoints
@@ -61,45 +57,25 @@ bool verifyResults(const std::vector<double> &x, const std::vector<double> &yAd,
  */
 double verifyPercent(const std::vector<double> &x, const std::vector<double> &yAd, const std::vector<double> &xAd) {
     std::srand(std::time(nullptr));
+    const int runs = (100 + TAD_DIRECTIONS - 1) / TAD_DIRECTIONS;
     int right = 0;
-#pragma omp parallel for default(none) shared(x, yAd, xAd,right)
-    for (int i = 0; i < 100; ++i) {
-        if (verifyResults(x, yAd, xAd)) {
+#pragma omp parallel for default(none) shared(x, yAd, xAd, right, runs)
+    for (int i = 0; i < runs; ++i) {
+        int r = verifyResults(x, yAd, xAd);
 #pragma omp atomic
-            right++;
-        }
+        right += r;
     }
-    return (double)right/100.;
+    return (double)right / (runs * TAD_DIRECTIONS);
 }
 
+/**
+ * Prints the tangents of the outputs for the tangents xTan of the inputs
+ */
 void getTan(const std::vector<double> &x, const std::vector<double> &xTan) {
-    double deltaH = 0;
-    for (int i = 0; i < x.size(); i++) {
-        deltaH += x[i];
-    }
-
-    std::vector<double> delta(x.size());
-    for (int i = 0; i < x.size(); i++) {
-        delta[i] = pow(2, -15)*deltaH;
-    }
-
-    std::vector<double> t1(x.size());
-    for (int i = 0; i < x.size(); i++) {
-        t1[i] = x[i] + delta[i]*xTan[i];
-    }
-
-    std::vector<double> t2 = x;
-    PRIMAL::primal(t1);
-    PRIMAL::primal(t2);
-
-    std::vector<double> yTan(x.size());
-    for (int i = 0; i < x.size(); i++) {
-        if (delta[i] != 0) {
-            yTan[i] = (t1[i] - t2[i]) / delta[i];
-        } else {
-            yTan[i] = 0;
-        }
-        printf("%f ", yTan[i]);
+    std::vector<std::vector<double>> yTan = {xTan};
+    tad(x, yTan);
+    for (uint64_t i = 0; i < x.size(); i++) {
+        printf("%f ", yTan[0][i]);
     }
 }
 
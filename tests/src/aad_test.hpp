@@ -31,4 +31,100 @@ TEST(AadTest, main2) {
     ASSERT_NEAR(adj[0], 0.391, 0.001);
 }
 
+/**
+ * The vector mode reversal of several seeds gives the adjoints of reversing every seed on its own
+ */
+TEST(AadTest, multi) {
+    std::vector<double> in = {1,0};
+    std::vector<std::vector<double>> seeds = {{0,1}, {1,0}, {2,3}};
+    auto adj = seeds;
+
+    size = 16;
+    windowSize = 8;
+    recalculateValues();
+
+    uint64_t t = 0;
+    aadMulti(in, adj, t);
+
+    for (uint64_t j = 0; j < adj.size(); ++j) {
+        std::vector<double> single = seeds[j];
+        aad(in, single);
+        ASSERT_NEAR(adj[j][0], single[0], 1e-12);
+        ASSERT_NEAR(adj[j][1], single[1], 1e-12);
+    }
+    ASSERT_NEAR(adj[0][0], 0.391, 0.001);
+}
+/**
+ * Kept tapes (in memory and spilled) have to reproduce the adjoints of a full aad run
+ */
+TEST(AadTest, retain) {
+    std::vector<double> in = {1,0};
+
+    size = 16;
+    windowSize = 8;
+    recalculateValues();
+
+    std::vector<double> expected = {2,3};
+    aad(in, expected);
+    // aad() narrows its tapes with MIXED_PRECISION, the retained tapes keep their doubles
+    const double tolerance = (MIXED_PRECISION ? MIXED_TOLERANCE : 1e-12)
+                             * std::max({1., std::abs(expected[0]), std::abs(expected[1])});
+
+    for (uint64_t budget : {std::numeric_limits<uint64_t>::max(), (uint64_t)0}) {
+        retainedTape r(budget, "./");
+        std::vector<double> none;
+        uint64_t t = 0;
+        aad(in, none, t, &r);
+        EXPECT_EQ(r.chunks(), chunks);
+
+        std::vector<double> adj = {2,3};
+        r.reverse(adj);
+        EXPECT_EQ(adj.size(), expected.size());
+        ASSERT_NEAR(adj[0], expected[0], tolerance);
+        ASSERT_NEAR(adj[1], expected[1], tolerance);
+
+        std::vector<std::vector<double>> multi = {{0,1}, {2,3}};
+        r.reverse(multi);
+        ASSERT_NEAR(multi[0][0], 0.391, 0.001);
+        ASSERT_NEAR(multi[1][0], expected[0], tolerance);
+    }
+}
+
+/**
+ * The tangents of tad() are the transposed adjoints of aad(), more directions than a run propagates take several runs
+ */
+TEST(AadTest, tad) {
+    std::vector<double> in = {1,0};
+
+    size = 16;
+    windowSize = 8;
+    recalculateValues();
+
+    std::vector<std::vector<double>> seeds = {{1,0}, {0,1}};
+    auto adj = seeds;
+    uint64_t t = 0;
+    aadMulti(in, adj, t);
+
+    std::vector<std::vector<double>> tangents;
+    for (int j = 0; j < TAD_DIRECTIONS + 1; ++j) {
+        tangents.push_back({1. + j, 2. - j});
+    }
+    auto dx = tangents;
+    std::vector<double> out = tad(in, tangents);
+
+    std::vector<double> y = in;
+    test_function::primal(y);
+    EXPECT_EQ(out, y);
+    // the adjoints of narrowed tapes are off within the bound of verify.hpp
+    const double tolerance = MIXED_PRECISION ? verifyTolerance : 1e-12;
+    for (uint64_t j = 0; j < tangents.size(); ++j) {
+        for (int i = 0; i < 2; ++i) {
+            // output i in direction j is row i of the Jacobian times the direction
+            EXPECT_NEAR(tangents[j][i], adj[i][0] * dx[j][0] + adj[i][1] * dx[j][1],
+                        tolerance * std::max(1., std::abs(tangents[j][i])));
+        }
+    }
+    EXPECT_EQ(verifyPercent(in, seeds[1], adj[1]), 1);
+}
+
 #endif //ADJOINT_AAD_TEST_HPP
@@ -3,6 +3,23 @@
 
 #include <dag.hpp>
 #include <double_o.hpp>
+#include <tapePool.hpp>
+#include <preaccumulation.hpp>
+#include <levelSchedule.hpp>
+#include <deadTape.hpp>
+#include <tapeCodec.hpp>
+#include <reevaluate.hpp>
+#include <sharedStructure.hpp>
+#include <nativeKernel.hpp>
+#include <slotRecycling.hpp>
+#include <mixedPrecision.hpp>
+#include <intrinsics.hpp>
+#include <externalFunction.hpp>
+#include <retainedTape.hpp>
+#include <sstream>
+#include <cstdlib>
+#include <dirent.h>
+#include <unistd.h>
 #include "gtest/gtest.h"
 
 /**
@@ -74,6 +91,783 @@ TEST(DagTest, AllAroundTest) {
     delete c;
 }
 
+/**
+ * The reversal tape only keeps records with edges, sorted by arity,
+ * and has to yield the same adjoints when it is interpreted repeatedly.
+ */
+TEST(DagTest, FinalizeTest) {
+    std::vector<double_o> t(2, 2);
+    dag* c = new dag();
+    c->recordOps = false;
+    t[0].registerInput(c);
+    t[1].registerInput(c);
+
+    t[0] = t[0] * t[1];
+    t[1] = sin(t[0]);
+
+    c->finalize();
+    EXPECT_TRUE(c->v.empty());
+    EXPECT_EQ(c->kinds.size(), 2);
+    EXPECT_EQ(c->binary.size(), 3);
+    EXPECT_EQ(c->unary.size(), 2);
+
+    for (int i = 0; i < 2; ++i) {
+        std::vector<double> adj(c->getRam(), 0);
+        adj[1] = 1;
+        c->interpret(adj);
+        EXPECT_EQ(adj[0], cos(4.) * 2);
+        EXPECT_EQ(adj[1], cos(4.) * 2);
+    }
+
+    delete c;
+}
+/**
+ * Sums and differences are stored without their partials
+ */
+TEST(DagTest, UnitPartialTest) {
+    dag c;
+    std::vector<double_o> t(4, 2);
+    for (int i = 0; i < 2; ++i) {
+        t[i].registerInput(&c);
+    }
+    t[2] = t[0] + t[1];
+    t[3] = t[1] - t[2];
+    t[0] = -t[3];
+    t[1] = t[0] * t[1];
+
+    c.finalize();
+    EXPECT_EQ(c.kinds.size(), 4);
+    EXPECT_EQ(c.d.size(), 2);
+
+    std::vector<double> adj(c.getRam(), 0);
+    adj[1] = 1;
+    c.interpret(adj);
+    // t1 = -(t1 - (t0 + t1)) * t1 = t0 * t1
+    EXPECT_EQ(adj[0], 2);
+    EXPECT_EQ(adj[1], 2);
+}
+/**
+ * A pooled tape is handed out empty but keeps its memory between chunks
+ */
+TEST(DagTest, PoolTest) {
+    tapePool pool(1);
+    std::vector<double_o> t(6, 1);
+
+    dag* c = pool.acquire(0);
+    f(t, c);
+    c->finalize();
+    uint64_t capacity = c->d.capacity();
+    pool.release(c);
+
+    dag* c2 = pool.acquire(0);
+    EXPECT_EQ(c, c2);
+    EXPECT_EQ(c2->getRam(), 1);
+    EXPECT_TRUE(c2->d.empty());
+    EXPECT_GE(c2->d.capacity(), capacity);
+
+    f(t, c2);
+    EXPECT_EQ(c2->getRam(), 8);
+    pool.release(c2);
+}
+
+/**
+ * Helper values that are read once before they are overwritten (u) can be eliminated
+ */
+void h(std::vector<double_o> inout, dag* g) {
+    for (uint64_t i = 0; i < inout.size(); ++i) {
+        inout[i].registerInput(g);
+    }
+
+    double_o u;
+    u = sin(inout[0]);
+    inout[1] = u * inout[1];
+    u = cos(inout[1]);
+    inout[0] = u + inout[0] * inout[1];
+}
+
+/**
+ * Eliminating single use values has to shrink the tape without changing the adjoints
+ */
+TEST(DagTest, PreaccumulationTest) {
+    std::vector<double_o> t(2, 0.5);
+    dag* c = new dag();
+    dag* p = new dag();
+    h(t, c);
+    h(t, p);
+
+    c->finalize();
+    preaccumulate(*p);
+    EXPECT_EQ(p->kinds.size(), c->kinds.size() - 1);
+    EXPECT_EQ(p->getRam(), c->getRam());
+
+    for (uint64_t i = 0; i < t.size(); ++i) {
+        std::vector<double> adj(c->getRam(), 0);
+        adj[i] = 1;
+        std::vector<double> adj2 = adj;
+        c->interpret(adj);
+        p->interpret(adj2);
+        for (uint64_t j = 0; j < t.size(); ++j) {
+            EXPECT_NEAR(adj[j], adj2[j], 1e-14);
+        }
+    }
+
+    delete c;
+    delete p;
+}
+/**
+ * Running out of ids has to fail loudly, wider id types take more persistent variables
+ */
+TEST(DagTest, IdWidthTest) {
+    basic_dag<int8_t> narrow;
+    for (int i = 0; i < 127; ++i) {
+        narrow.getId(true);
+    }
+    EXPECT_THROW(narrow.getId(true), std::overflow_error);
+
+    const int n = 40000;
+    basic_dag<int> c;
+    std::vector<basic_double_o<int>> t(n, 1.5);
+    for (int i = 0; i < n; ++i) {
+        t[i].registerInput(&c);
+    }
+    basic_double_o<int> sum = 0;
+    for (int i = 0; i < n; ++i) {
+        sum = sum + t[i] * t[i];
+    }
+    EXPECT_EQ(c.getPersistent(), n + 1);
+    EXPECT_EQ(c.requiredIdBytes(), 4);
+
+    std::vector<double> adj(c.getRam(), 0);
+    adj[n] = 1;
+    c.interpret(adj);
+    for (int i = 0; i < n; i += 997) {
+        EXPECT_EQ(adj[i], 3);
+    }
+}
+/**
+ * A tape beyond the memory budget grows into a scratch file and reverses to the same adjoints
+ */
+TEST(DagTest, SpillTest) {
+    auto record = [](dag &c) {
+        std::vector<double_o> t(2, 0.5);
+        t[0].registerInput(&c);
+        t[1].registerInput(&c);
+        for (int i = 0; i < 200000; ++i) {
+            t[0] = sin(t[0]) * t[1];
+        }
+    };
+
+    dag memory;
+    record(memory);
+    memory.finalize();
+
+    uint64_t budget = tapeSpill::getBudget();
+    std::string previous = tapeSpill::getDirectory();
+    char directory[] = "/tmp/adjoint-spill-XXXXXX";
+    ASSERT_NE(mkdtemp(directory), nullptr);
+    tapeSpill::setDirectory(std::string(directory) + "/");
+    tapeSpill::setBudget(1024 * 1024);
+    dag* spilled = new dag();
+    record(*spilled);
+    EXPECT_GT(tapeSpill::mapped(), 0);
+
+    for (int i = 0; i < 2; ++i) {
+        std::vector<double> adj(memory.getRam(), 0);
+        adj[0] = 1;
+        std::vector<double> adj2 = adj;
+        memory.interpret(adj);
+        spilled->interpret(adj2);
+        EXPECT_EQ(adj[0], adj2[0]);
+        EXPECT_EQ(adj[1], adj2[1]);
+    }
+
+    delete spilled;
+    EXPECT_EQ(tapeSpill::mapped(), 0);
+    tapeSpill::setBudget(budget);
+    tapeSpill::setDirectory(previous);
+    EXPECT_EQ(rmdir(directory), 0);
+}
+/**
+ * Reordering a tape into levels and reversing it on several threads keeps the adjoints
+ */
+TEST(DagTest, LevelScheduleTest) {
+    const int n = 1000;
+    auto record = [](dag &c) {
+        std::vector<double_o> t(n, 0.5);
+        for (int i = 0; i < n; ++i) {
+            t[i].registerInput(&c);
+        }
+        for (int j = 0; j < 5; ++j) {
+            for (int i = 0; i < n; ++i) {
+                t[i] = sin(t[i]) * t[(i + 1) % n];
+            }
+            t[0] = t[0] + t[n / 2];
+        }
+    };
+
+    dag c, s;
+    record(c);
+    record(s);
+    c.finalize();
+    levelSchedule(s, 4, 16);
+    EXPECT_EQ(s.kinds.size(), c.kinds.size());
+    EXPECT_EQ(s.partThreads, 4);
+    EXPECT_GT(s.parts.size(), 4);
+
+    std::vector<double> adj(c.getRam(), 0);
+    for (int i = 0; i < n; ++i) {
+        adj[i] = 1.0 / (i + 1);
+    }
+    std::vector<double> adj2 = adj;
+    c.interpret(adj);
+    s.interpret(adj2);
+    for (int i = 0; i < n; ++i) {
+        EXPECT_NEAR(adj[i], adj2[i], 1e-12);
+    }
+}
+/**
+ * Records that cannot reach a seeded adjoint are removed, the liveness carries over to the previous chunk
+ */
+TEST(DagTest, DeadTapeTest) {
+    auto record = [](dag &c) {
+        std::vector<double_o> t(4, 0.5);
+        for (int i = 0; i < 4; ++i) {
+            t[i].registerInput(&c);
+        }
+        for (int j = 0; j < 10; ++j) {
+            t[0] = sin(t[0]) * t[1];
+            t[2] = cos(t[2]) * t[3];
+        }
+    };
+
+    dag c, p;
+    record(c);
+    record(p);
+    c.finalize();
+
+    std::vector<double> adj(c.getRam(), 0);
+    adj[0] = 1;
+    std::vector<char> live;
+    for (auto a : adj) {
+        live.push_back(a != 0);
+    }
+    eliminateDead(p, live);
+    EXPECT_EQ(p.kinds.size(), c.kinds.size() / 2);
+    EXPECT_TRUE(live[0] && live[1]);
+    EXPECT_FALSE(live[2] || live[3]);
+
+    std::vector<double> adj2 = adj;
+    c.interpret(adj);
+    p.interpret(adj2);
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(adj[i], adj2[i]);
+    }
+}
+
+/**
+ * A compressed tape spanning several blocks reverses to the same adjoints, also after a write/read round trip
+ */
+TEST(DagTest, CompressionTest) {
+    dag c;
+    std::vector<double_o> t(4, 0.5);
+    for (int i = 0; i < 4; ++i) {
+        t[i].registerInput(&c);
+    }
+    for (int j = 0; j < 40000; ++j) {
+        t[0] = sin(t[0]) * t[1] + t[2];
+        t[2] = t[3] - cos(t[2]) * 0.999;
+    }
+    c.finalize();
+
+    compressedTape z(c);
+    EXPECT_EQ(z.getRam(), c.getRam());
+    EXPECT_LT(z.getMemorySize(), c.getMemorySize() / 2);
+
+    std::stringstream file;
+    z.write(file);
+    compressedTape r;
+    r.read(file);
+
+    std::vector<double> adj(c.getRam(), 0);
+    adj[0] = 1;
+    adj[2] = 2;
+    std::vector<double> adj2 = adj, adj3 = adj;
+    c.interpret(adj);
+    z.interpret(adj2);
+    r.interpret(adj3);
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(adj[i], adj2[i]);
+        EXPECT_EQ(adj[i], adj3[i]);
+    }
+}
+
+/**
+ * A tape repeating a loop body shares its structure and reverses to the same adjoints, unshare() restores it
+ */
+TEST(DagTest, SharedStructureTest) {
+    auto record = [](dag &c) {
+        std::vector<double_o> t(4, 0.5);
+        for (int i = 0; i < 4; ++i) {
+            t[i].registerInput(&c);
+        }
+        t[1] = t[1] * t[3];
+        for (int j = 0; j < 1000; ++j) {
+            t[0] = sin(t[0]) * t[1] + t[2];
+            t[2] = t[3] - cos(t[2]) * 0.999;
+            t[3] = t[3] + t[0];
+        }
+        t[3] = t[3] / t[1];
+    };
+
+    dag c, s;
+    record(c);
+    record(s);
+    c.finalize();
+    shareStructure(s, 16);
+    EXPECT_FALSE(s.runs.empty());
+    EXPECT_LT(s.kinds.size() * 10, c.kinds.size());
+    EXPECT_EQ(s.d.size(), c.d.size());
+    EXPECT_EQ(s.getSizes().kinds, c.kinds.size());
+
+    std::vector<double> adj(c.getRam(), 0);
+    adj[0] = 1;
+    adj[3] = 2;
+    std::vector<double> adj2 = adj;
+    c.interpret(adj);
+    s.interpret(adj2);
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(adj[i], adj2[i]);
+    }
+
+    std::vector<double> lanes(c.getRam() * 2, 0), lanes2;
+    lanes[0] = 1;
+    lanes[3 * 2 + 1] = 1;
+    lanes2 = lanes;
+    c.interpret(lanes, 2);
+    s.interpret(lanes2, 2);
+    for (uint64_t i = 0; i < lanes.size(); ++i) {
+        EXPECT_EQ(lanes[i], lanes2[i]);
+    }
+
+    s.unshare();
+    EXPECT_TRUE(s.runs.empty());
+    EXPECT_TRUE(s.kinds == c.kinds);
+    EXPECT_TRUE(s.unary == c.unary);
+    EXPECT_TRUE(s.binary == c.binary);
+    EXPECT_TRUE(s.nary == c.nary);
+}
+
+/**
+ * The shared runs of a tape compiled to native kernels reverse to the same adjoints
+ */
+TEST(DagTest, NativeKernelTest) {
+    dag c, s;
+    for (dag* g : {&c, &s}) {
+        std::vector<double_o> t(4, 0.5);
+        for (int i = 0; i < 4; ++i) {
+            t[i].registerInput(g);
+        }
+        for (int j = 0; j < 1000; ++j) {
+            t[0] = sin(t[0]) * t[1] + t[2];
+            t[2] = t[3] - cos(t[2]) * 0.999;
+            t[3] = t[3] + t[0] * t[1] * t[2];
+        }
+    }
+    c.finalize();
+    shareStructure(s, 16);
+    // a fresh directory, kernels left behind by earlier runs would be loaded instead of compiled
+    char directory[] = "/tmp/adjoint-kernels-XXXXXX";
+    ASSERT_NE(mkdtemp(directory), nullptr);
+    kernelCache::setDirectory(std::string(directory) + "/");
+    compileRuns(s);
+    kernelCache::setDirectory(NATIVE_KERNEL_DIR);
+    int compiled = 0;
+    for (auto &r : s.runs) {
+        if (r.native != nullptr) compiled++;
+    }
+    int objects = 0;
+    if (DIR* d = opendir(directory)) {
+        while (dirent* e = readdir(d)) {
+            std::string name = e->d_name;
+            if (name == "." || name == "..") continue;
+            objects++;
+            std::remove((std::string(directory) + "/" + name).c_str());
+        }
+        closedir(d);
+    }
+    rmdir(directory);
+    if (compiled == 0) GTEST_SKIP() << "no compiler available for native kernels";
+    EXPECT_GT(objects, 0);
+
+    std::vector<double> adj(c.getRam(), 0);
+    adj[0] = 1;
+    adj[3] = 2;
+    std::vector<double> adj2 = adj;
+    c.interpret(adj);
+    s.interpret(adj2);
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(adj[i], adj2[i]);
+    }
+}
+
+/**
+ * Recycling the slot of a value at the record defining it, whether or not its double_o is still in scope, bounds the
+ * adjoint vector, the inputs keep their adjoints
+ */
+TEST(DagTest, SlotRecyclingTest) {
+    dag c, r;
+    for (dag* g : {&c, &r}) {
+        g->recordOps = false;
+        std::vector<double_o> t(2, 0.5);
+        for (int i = 0; i < 2; ++i) {
+            t[i].registerInput(g);
+        }
+        for (int j = 0; j < 100; ++j) {
+            double_o x, y;
+            x = sin(t[0]) * t[1];
+            y = x * x + t[0];
+            t[0] = y / t[1];
+        }
+    }
+    c.finalize();
+    recycleSlots(r);
+    EXPECT_GT(c.getRam(), 200);
+    EXPECT_LT(r.getRam(), 6);
+    EXPECT_EQ(r.getPersistent(), 2);
+
+    std::vector<double> adj(c.getRam(), 0);
+    adj[0] = 1;
+    adj[1] = 2;
+    std::vector<double> adj2(r.getRam(), 0);
+    adj2[0] = 1;
+    adj2[1] = 2;
+    c.interpret(adj);
+    r.interpret(adj2);
+    EXPECT_EQ(adj[0], adj2[0]);
+    EXPECT_EQ(adj[1], adj2[1]);
+}
+
+/**
+ * Re-evaluating a tape on new inputs gives the tape of taping the primal on them, unless a branch diverges
+ */
+TEST(DagTest, ReevaluateTest) {
+    auto record = [](dag &c, std::vector<double> in) {
+        c.recordOps = true;
+        std::vector<double_o> t(in.begin(), in.end());
+        for (int i = 0; i < 4; ++i) {
+            t[i].registerInput(&c);
+        }
+        for (int j = 0; j < 5; ++j) {
+            double_o u = t[0] * t[0] - sin(t[1]) / t[2] + 2.0 * t[3];
+            if (u < 0) {
+                t[1] = u * t[0] - 1;
+            } else {
+                t[1] = cos(u) - t[2] / 3;
+            }
+            t[3] = t[1];
+            t[2] = pow(t[3], 2) + 1 / (t[2] + 4) - -t[0];
+            t[0] = 0.5 - t[0] * 0.9;
+        }
+        return t;
+    };
+
+    std::vector<double> first = {0.3, 0.2, 1.5, -0.1}, second = {0.31, 0.19, 1.52, -0.1};
+    dag c, expected;
+    record(c, first);
+    auto t = record(expected, second);
+    expected.finalize();
+
+    std::vector<double> values;
+    ASSERT_TRUE(reevaluate(c, second, values));
+    ASSERT_EQ(c.d.size(), expected.d.size());
+    ASSERT_EQ(c.kinds.size(), expected.kinds.size());
+    for (uint64_t i = 0; i < c.d.size(); ++i) {
+        EXPECT_EQ(c.d[i], expected.d[i]);
+    }
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(values[c.adjoint_id(t[i].id)], t[i].getValue());
+    }
+
+    std::vector<double> adj(c.getRam(), 0), adj2(c.getRam(), 0);
+    adj[c.adjoint_id(t[2].id)] = 1;
+    adj2[c.adjoint_id(t[2].id)] = 1;
+    c.interpret(adj);
+    expected.interpret(adj2);
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_EQ(adj[i], adj2[i]);
+    }
+
+    // a rewritten tape is rebuilt from the recording
+    preaccumulate(c);
+    ASSERT_TRUE(reevaluate(c, second, values));
+    ASSERT_EQ(c.d.size(), expected.d.size());
+    for (uint64_t i = 0; i < c.d.size(); ++i) {
+        EXPECT_EQ(c.d[i], expected.d[i]);
+    }
+
+    // the first guard flips
+    uint64_t size = c.d.size();
+    EXPECT_FALSE(reevaluate(c, {3, 0.2, 1.5, 1}, values));
+    EXPECT_EQ(c.d.size(), size);
+
+    dag passive;
+    passive.recordOps = false;
+    EXPECT_THROW(reevaluate(passive, first, values), std::invalid_argument);
+}
+
+/**
+ * Compound assignments and fma (OP_FMA) are replayed with the values and partials of taping them on the new inputs
+ */
+TEST(DagTest, ReevaluateFmaTest) {
+    auto record = [](dag &c, std::vector<double> in) {
+        c.recordOps = true;
+        std::vector<double_o> t(in.begin(), in.end());
+        for (auto &x : t) {
+            x.registerInput(&c);
+        }
+        for (int j = 0; j < 3; ++j) {
+            t[2] += t[0] * t[1];
+            t[1] *= sin(t[2]);
+            t[0] /= t[1] + 2;
+            t[2] = fma(t[0], t[1], 0.5 * t[2]);
+        }
+        return t;
+    };
+
+    std::vector<double> first = {0.3, 1.2, 0.7}, second = {0.35, 1.1, 0.6};
+    dag c, expected;
+    record(c, first);
+    auto t = record(expected, second);
+    expected.finalize();
+
+    std::vector<double> values;
+    ASSERT_TRUE(reevaluate(c, second, values));
+    ASSERT_EQ(c.d.size(), expected.d.size());
+    for (uint64_t i = 0; i < c.d.size(); ++i) {
+        EXPECT_EQ(c.d[i], expected.d[i]);
+    }
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_EQ(values[c.adjoint_id(t[i].id)], t[i].getValue());
+    }
+}
+
+/**
+ * Float partials halve the partials and keep the adjoints within the tolerance, a tape over the tolerance keeps its doubles
+ */
+TEST(DagTest, MixedPrecisionTest) {
+    dag c, m;
+    for (dag* g : {&c, &m}) {
+        std::vector<double_o> t(2, 0.3);
+        for (int i = 0; i < 2; ++i) {
+            t[i].registerInput(g);
+        }
+        for (int j = 0; j < 50; ++j) {
+            t[0] = sin(t[0]) * t[1] + 0.1;
+            t[1] = t[1] * t[0] - cos(t[1]);
+        }
+    }
+    c.finalize();
+    std::vector<double> partials(c.d.begin(), c.d.end());
+    uint64_t size = c.d.size();
+    EXPECT_FALSE(narrowPartials(c, 0));
+    EXPECT_EQ(c.narrowed, 0u);
+    EXPECT_TRUE(std::equal(partials.begin(), partials.end(), c.d.begin()));
+
+    EXPECT_TRUE(narrowPartials(m, 1e-3));
+    EXPECT_EQ(m.narrowed, size);
+    EXPECT_EQ(m.d.size(), (size + 1) / 2);
+
+    std::vector<double> adj(c.getRam(), 0);
+    adj[0] = 1;
+    adj[1] = 2;
+    std::vector<double> adj2 = adj;
+    c.interpret(adj);
+    m.interpret(adj2);
+    for (int i = 0; i < 2; ++i) {
+        EXPECT_NEAR(adj[i], adj2[i], 1e-3 * (std::fabs(adj[i]) + 1));
+    }
+
+    // float partials are exact as doubles again
+    m.widen();
+    EXPECT_EQ(m.d.size(), size);
+    for (uint64_t i = 0; i < size; ++i) {
+        EXPECT_EQ(m.d[i], (double)(float)partials[i]);
+    }
+}
+
+/**
+ * Intrinsics recorded as single records give the values and adjoints of the elementwise records on a fraction of the tape
+ */
+TEST(DagTest, IntrinsicsTest) {
+    dag e, c;
+    e.recordIntrinsics = false;
+    c.recordIntrinsics = true;
+    e.recordOps = false;
+    c.recordOps = false;
+    std::vector<double> values[2], adjoints[2];
+    for (int k = 0; k < 2; ++k) {
+        dag* g = k == 0 ? &e : &c;
+        int n = 6;
+        std::vector<double_o> A((n - 2) * 3 + 4, 0), b(n), x(n);
+        std::vector<double> w(n);
+        for (int i = 1; i < n - 1; ++i) {
+            A[3 * i] = 4 + 0.1 * i;
+            A[3 * i + 1] = 1 - 0.2 * i;
+            A[3 * i - 1] = 0.5 + 0.1 * i;
+        }
+        for (int i = 0; i < n; ++i) {
+            b[i] = 1 + 0.3 * i;
+            x[i] = 0.2 * i - 0.5;
+            w[i] = i - 2.5;
+        }
+        // the sub diagonal entry of the first row stays passive
+        std::vector<double_o*> in;
+        for (int i = 3; i <= 3 * (n - 2) + 1; ++i) {
+            in.push_back(&A[i]);
+        }
+        for (int i = 0; i < n; ++i) {
+            in.push_back(&b[i]);
+            in.push_back(&x[i]);
+        }
+        std::vector<int> offsets;
+        for (double_o* d : in) {
+            d->registerInput(g);
+            offsets.push_back(g->adjoint_id(d->id));
+        }
+
+        solveTridiagonal(A, b);
+        axpy(0.5, x, b);
+        double_o s;
+        s = dot(b, x) + scaledSum(w, b);
+
+        for (int i = 0; i < n; ++i) {
+            values[k].push_back(b[i].getValue());
+        }
+        values[k].push_back(s.getValue());
+        std::vector<double> adj(g->getRam(), 0);
+        adj[g->adjoint_id(s.id)] = 1;
+        g->interpret(adj);
+        for (int o : offsets) {
+            adjoints[k].push_back(adj[o]);
+        }
+    }
+
+    EXPECT_EQ(c.calls, 2u);
+    EXPECT_LT(5 * c.kinds.size(), e.kinds.size());
+    for (uint64_t i = 0; i < values[0].size(); ++i) {
+        EXPECT_EQ(values[0][i], values[1][i]);
+    }
+    for (uint64_t i = 0; i < adjoints[0].size(); ++i) {
+        EXPECT_NEAR(adjoints[0][i], adjoints[1][i], 1e-12 * (std::fabs(adjoints[0][i]) + 1));
+    }
+}
+
+/**
+ * An external function with a hand written adjoint gives the adjoints of taping its operations
+ */
+TEST(DagTest, ExternalFunctionTest) {
+    auto primal = [](const std::vector<double> &x, std::vector<double> &y) {
+        y[0] = x[0] * x[1];
+        y[1] = std::sin(x[0]) + x[2];
+    };
+    std::vector<std::vector<double>> checkpoints;
+    auto adjoint = [&checkpoints](const std::vector<double> &x, const std::vector<double> &yAdjoint, std::vector<double> &xAdjoint) {
+        checkpoints.push_back(x);
+        xAdjoint[0] = yAdjoint[0] * x[1] + yAdjoint[1] * std::cos(x[0]);
+        xAdjoint[1] = yAdjoint[0] * x[0];
+        xAdjoint[2] = yAdjoint[1];
+    };
+
+    dag e, c;
+    c.recordOps = false;
+    std::vector<double> adjoints[2];
+    for (int k = 0; k < 2; ++k) {
+        dag* g = k == 0 ? &e : &c;
+        std::vector<double_o> x = {0.3, 1.7, -0.4}, y(2);
+        for (int i = 0; i < 2; ++i) {
+            x[i].registerInput(g);
+        }
+        x[0] = x[0] * x[1];
+        if (k == 0) {
+            y[0] = x[0] * x[1];
+            y[1] = sin(x[0]) + x[2];
+        } else {
+            externalFunction(primal, adjoint, x, y);
+        }
+        double_o s;
+        s = y[0] * y[1];
+
+        std::vector<double> adj(g->getRam(), 0);
+        adj[g->adjoint_id(s.id)] = 1;
+        g->interpret(adj);
+        adjoints[k] = {adj[0], adj[1]};
+    }
 
+    EXPECT_EQ(c.calls, 1u);
+    ASSERT_EQ(checkpoints.size(), 1u);
+    EXPECT_EQ(checkpoints[0], std::vector<double>({0.3 * 1.7, 1.7, -0.4}));
+    for (int i = 0; i < 2; ++i) {
+        EXPECT_NEAR(adjoints[0][i], adjoints[1][i], 1e-14);
+    }
+
+    std::stringstream out;
+    EXPECT_THROW(c.write(out), std::invalid_argument);
+    c.reset();
+    EXPECT_TRUE(c.externals.empty());
+}
+
+/**
+ * Compressed and retained tapes, in memory and spilled, keep the callbacks of their external functions
+ */
+TEST(DagTest, RetainedExternalFunctionTest) {
+    auto primal = [](const std::vector<double> &x, std::vector<double> &y) {
+        y[0] = x[0] * x[1];
+    };
+    int calls = 0;
+    auto adjoint = [&calls](const std::vector<double> &x, const std::vector<double> &yAdjoint, std::vector<double> &xAdjoint) {
+        ++calls;
+        xAdjoint[0] = yAdjoint[0] * x[1];
+        xAdjoint[1] = yAdjoint[0] * x[0];
+    };
+    auto record = [&](dag* g) {
+        g->recordOps = false;
+        std::vector<double_o> x = {0.3, 1.7}, y(1);
+        for (auto &v : x) {
+            v.registerInput(g);
+        }
+        x[0] = sin(x[0]);
+        externalFunction(primal, adjoint, x, y);
+        double_o s;
+        s = y[0] * x[1];
+        g->finalize();
+        return g->adjoint_id(s.id);
+    };
+    const std::vector<double> expected = {std::cos(0.3) * 1.7 * 1.7, 2 * std::sin(0.3) * 1.7};
+
+    dag c;
+    auto out = record(&c);
+    compressedTape t(c);
+    std::vector<double> adj(t.getRam(), 0);
+    adj[out] = 1;
+    t.interpret(adj);
+    EXPECT_NEAR(adj[0], expected[0], 1e-14);
+    EXPECT_NEAR(adj[1], expected[1], 1e-14);
+    EXPECT_EQ(calls, 1);
+
+    for (uint64_t budget : {std::numeric_limits<uint64_t>::max(), (uint64_t)0}) {
+        calls = 0;
+        retainedTape r(budget, "./");
+        dag* g = new dag();
+        out = record(g);
+        std::vector<double> seed(g->getRam(), 0);
+        seed[out] = 1;
+        r.keep(1, g);
+
+        r.reverse(seed);
+        EXPECT_NEAR(seed[0], expected[0], 1e-14);
+        EXPECT_NEAR(seed[1], expected[1], 1e-14);
+        EXPECT_EQ(calls, 1);
+    }
+}
 
 #endif //ADJOINT_DAG_TEST_HPP
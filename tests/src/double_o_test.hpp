@@ -2,6 +2,9 @@
 #define ADJOINT_DOUBLE_O_TEST_HPP
 
 #include <double_o.hpp>
+#include <double_l.hpp>
+#include <double_tan.hpp>
+#include <thread>
 #include "gtest/gtest.h"
 
 TEST(DoubleOTest, MathmaticsTest) {
@@ -13,5 +16,231 @@ TEST(DoubleOTest, MathmaticsTest) {
     ASSERT_EQ((cos(sin(x))).getValue(), cos(sin(5)));
 }
 
+/**
+ * A whole right hand side is recorded as one node holding the derivatives in direction of its leaves
+ */
+TEST(DoubleOTest, ExpressionTest) {
+    dag* g = new dag();
+    double_o x = 2;
+    double_o y = 3;
+    double_o z;
+    x.registerInput(g);
+    y.registerInput(g);
+
+    z = x*y + sin(x) - y/x;
+    EXPECT_EQ(z.getValue(), 6 + sin(2.) - 1.5);
+
+    g->finalize();
+    EXPECT_EQ(g->kinds.size(), 1);
+    EXPECT_EQ(g->binary.size(), 3);
+
+    std::vector<double> adj(g->getRam(), 0);
+    adj[2] = 1;
+    g->interpret(adj);
+    EXPECT_NEAR(adj[0], 3 + cos(2.) + 3./4, 1e-14);
+    EXPECT_NEAR(adj[1], 2 - 1./2, 1e-14);
+
+    delete g;
+}
+/**
+ * Assigning a persistent double_o aliases it, the copy is only recorded once its source is overwritten
+ */
+TEST(DoubleOTest, AliasTest) {
+    dag* g = new dag();
+    double_o x = 2;
+    double_o y = 3;
+    double_o a, b;
+    x.registerInput(g);
+    y.registerInput(g);
+
+    a = x;
+    b = a * y;
+    // without ALIAS_COPIES the copy is recorded right away
+    EXPECT_EQ(g->v.size(), ALIAS_COPIES ? 4 + 4 : 4 + 3 + 4);
+
+    x = sin(x);
+    y = a * x;
+    g->finalize();
+    // the copy of a, sin(x), b and y
+    EXPECT_EQ(g->kinds.size(), 4);
+
+    std::vector<double> adj(g->getRam(), 0);
+    adj[1] = 1;
+    adj[3] = 1;
+    g->interpret(adj);
+    EXPECT_NEAR(adj[0], 3 + sin(2.) + 2 * cos(2.), 1e-14);
+    EXPECT_NEAR(adj[1], 2, 1e-14);
+
+    delete g;
+}
+
+/**
+ * Compound assignments and fma are recorded as the single node of their explicit forms
+ */
+TEST(DoubleOTest, CompoundAssignmentTest) {
+    auto explicitForm = [](std::vector<double_o> &t) {
+        t[2] = t[2] + t[0] * t[1];
+        t[2] = t[2] - 0.5;
+        t[1] = t[1] * sin(t[2]);
+        t[0] = t[0] / t[1];
+        t[2] = t[0] * t[1] + t[2];
+    };
+    auto compound = [](std::vector<double_o> &t) {
+        t[2] += t[0] * t[1];
+        t[2] -= 0.5;
+        t[1] *= sin(t[2]);
+        t[0] /= t[1];
+        t[2] = fma(t[0], t[1], t[2]);
+    };
+
+    std::vector<double> adj[2];
+    std::vector<double> values[2];
+    uint64_t records[2];
+    for (int k = 0; k < 2; ++k) {
+        dag g;
+        std::vector<double_o> t = {0.3, 1.2, 0.7};
+        for (auto &x : t) {
+            x.registerInput(&g);
+        }
+        k == 0 ? explicitForm(t) : compound(t);
+        for (auto &x : t) {
+            values[k].push_back(x.getValue());
+        }
+        g.finalize();
+        records[k] = g.kinds.size();
+        adj[k].assign(g.getRam(), 0);
+        for (int i = 0; i < 3; ++i) {
+            adj[k][g.adjoint_id(t[i].id)] = i + 1;
+        }
+        g.interpret(adj[k]);
+        adj[k].resize(3);
+    }
+    EXPECT_EQ(records[0], records[1]);
+    EXPECT_EQ(values[0][0], values[1][0]);
+    EXPECT_EQ(values[0][1], values[1][1]);
+    EXPECT_EQ(values[1][2], fma(values[1][0], values[1][1], 0.7 + 0.3 * 1.2 - 0.5));
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_NEAR(adj[0][i], adj[1][i], 1e-14);
+    }
+}
+
+/**
+ * double_tan propagates every direction on its own, a direction gets the derivative of the primal in its direction
+ */
+TEST(DoubleOTest, TangentTest) {
+    double_tan<3> x = 2, y = 3;
+    x.setTangent(0, 1);
+    y.setTangent(1, 1);
+    x.setTangent(2, 1);
+    y.setTangent(2, -2);
+
+    double_tan<3> z = x * y + sin(x) - y / x;
+    z += pow(y, 2) * 0.5;
+    z = fma(z, x, 1 - cos(y));
+    double v = 6 + sin(2.) - 1.5 + 4.5;
+    EXPECT_EQ(z.getValue(), fma(v, 2., 1 - cos(3.)));
+
+    double dx = (3 + cos(2.) + 3. / 4) * 2 + v;
+    double dy = (2 - 1. / 2 + 3) * 2 + sin(3.);
+    EXPECT_NEAR(z.getTangent(0), dx, 1e-13);
+    EXPECT_NEAR(z.getTangent(1), dy, 1e-13);
+    EXPECT_NEAR(z.getTangent(2), dx - 2 * dy, 1e-13);
+    EXPECT_TRUE(z > 0);
+}
+
+/**
+ * A double_o holds no tape pointer (16 bytes up to 32 bit tape ids), active double_o's are recorded on the active tape
+ * of their thread
+ */
+TEST(DoubleOTest, ActiveTapeTest) {
+    if (sizeof(TAPE_ID) <= 4) {
+        EXPECT_EQ(sizeof(double_o), 16u);
+    }
+
+    dag g, h;
+    double_o x = 2, y;
+    x.registerInput(&g);
+    EXPECT_EQ(double_o::activeTape(), &g);
+    EXPECT_EQ(x.tape(), &g);
+    EXPECT_EQ(y.tape(), nullptr);
+
+    y = x * x;
+    double_o z = y;
+    EXPECT_EQ(z.tape(), &g);
+    z = 1.5;
+    EXPECT_EQ(z.tape(), nullptr);
+
+    // another thread records on its own tape
+    dag* other = nullptr;
+    std::thread t([&]() {
+        double_o u = 1;
+        u.registerInput(&h);
+        u = u * 3;
+        other = double_o::activeTape();
+    });
+    t.join();
+    EXPECT_EQ(other, &h);
+    EXPECT_EQ(double_o::activeTape(), &g);
+    g.finalize();
+    h.finalize();
+    EXPECT_EQ(g.kinds.size(), 1u);
+    EXPECT_EQ(h.kinds.size(), 1u);
+}
+
+/**
+ * Scenarios taped as the lanes of one tape get the adjoints of taping every scenario on its own,
+ * lanes that branch differently than lane 0 are taped again
+ */
+TEST(DoubleOTest, ScenarioLanesTest) {
+    auto primal = [](auto &y) {
+        for (int k = 0; k < 3; ++k) {
+            y[0] = sin(y[0]) * y[1] + 0.5;
+            if (y[0] - y[1] < 0) {
+                y[1] = y[1] * y[0];
+            } else {
+                y[1] = y[1] / y[0] - y[2];
+            }
+            y[2] = y[2] * y[2] - y[0];
+        }
+    };
+    std::vector<std::vector<double>> in = {{0.3, 0.9, 0.1}, {0.3, 1.2, 0.1}, {0.2, 1.1, 0.3}, {1.5, 0.1, 0.4}, {0.35, 0.95, 0.2}};
+    std::vector<std::vector<double>> adjoints(in.size(), {1, 2, 3});
+    std::vector<std::vector<double>> expected = adjoints;
+
+    for (uint64_t s = 0; s < in.size(); ++s) {
+        dag g;
+        std::vector<double_o> y(in[s].begin(), in[s].end());
+        for (auto &x : y) {
+            x.registerInput(&g);
+        }
+        primal(y);
+        g.finalize();
+        std::vector<double> adj(g.getRam(), 0);
+        std::copy(expected[s].begin(), expected[s].end(), adj.begin());
+        g.interpret(adj);
+        std::copy(adj.begin(), adj.begin() + 3, expected[s].begin());
+    }
+
+    dag g;
+    std::vector<double_l<4>> y(3);
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            y[i].setValue(j, in[j][i]);
+        }
+        y[i].registerInput(&g);
+    }
+    double_l<4>::diverged() = 0;
+    primal(y);
+    EXPECT_EQ(double_l<4>::diverged(), 1u << 3);
+    EXPECT_EQ(g.scenarios, 4);
+
+    // the first batch keeps three lanes, the diverged one and the fifth scenario diverge again
+    EXPECT_EQ(aadScenarios<4>(primal, in, adjoints), 3);
+    for (uint64_t s = 0; s < in.size(); ++s) {
+        for (int i = 0; i < 3; ++i) {
+            EXPECT_DOUBLE_EQ(adjoints[s][i], expected[s][i]);
+        }
+    }
+}
 
 #endif //ADJOINT_DOUBLE_O_TEST_HPP
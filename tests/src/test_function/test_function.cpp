@@ -15,6 +15,7 @@ namespace test_function {
     }
     template void primal(std::vector<double> &inout);
     template void primal(std::vector<double_o> &inout);
+    template void primal(std::vector<double_tan<TAD_DIRECTIONS>> &inout);
 
 
     void primal(checkpoint c, dag* D) {